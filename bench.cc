@@ -1,14 +1,62 @@
 #include <benchmark/benchmark.h>
 
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <vector>
+
 #define LIBSIG_MAIN
+#ifdef __linux__
+#	define LIBSIG_EVENTFD
+#endif
 #include <sig.hh>
 
+/*
+	Counts every allocation made through the global operator new, so
+	benches can report heap usage alongside timings, and attributes it
+	to the running clock's stats. operator delete is replaced to match;
+	both are kept out of line so GCC can't flag the pairing as a
+	mismatched deallocation.
+*/
+static std::atomic<std::size_t> allocated_bytes(0);
+static std::atomic<std::size_t> allocation_count(0);
+
+#if defined(__GNUC__)
+#	define NOINLINE __attribute__((noinline))
+#else
+#	define NOINLINE
+#endif
+
+NOINLINE void * operator new(std::size_t n) {
+	allocated_bytes.fetch_add(n, std::memory_order_relaxed);
+	allocation_count.fetch_add(1, std::memory_order_relaxed);
+	libsig::detail::note_allocation(n);
+
+	if (void *p = std::malloc(n ? n : 1)) return p;
+	throw std::bad_alloc();
+}
+
+NOINLINE void operator delete(void *p) noexcept {
+	std::free(p);
+}
+
+NOINLINE void operator delete(void *p, std::size_t) noexcept {
+	std::free(p);
+}
+
 #define B(name, block) \
 	static void BM_##name(benchmark::State &state) block \
 	BENCHMARK(BM_##name)
 
 using namespace libsig;
 
+/* reports allocations made by the thread's clock per benchmark iteration */
+static void report_allocations(benchmark::State &state, std::uint64_t before) {
+	std::uint64_t allocations = S.stats().allocations - before;
+	state.counters["allocs_per_write"] = static_cast<double>(allocations) / static_cast<double>(state.iterations());
+}
+
 B(sig_write, {
 	sig<int> i;
 	for (auto _ : state) {
@@ -102,4 +150,542 @@ B(basic_computation, {
 	}
 });
 
+B(computation_expression, {
+	val<int> i(10);
+	val<int> j;
+
+	sig_root root([=]() mutable {
+		S([=]() mutable {
+			j = i * 10;
+		});
+	});
+
+	int v = 20;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(i = (v ^= 1));
+	}
+});
+
+B(derived_expression, {
+	val<int> i(10);
+	auto j = S.derive(expr(i) * 10);
+
+	int v = 20;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(i = (v ^= 1));
+	}
+});
+
+B(value_many_write, {
+	std::vector<val<float>> values(10000);
+	float v = 0.0f;
+	for (auto _ : state) {
+		v += 1.0f;
+		S.freeze([&] {
+			for (auto &value : values) value = v;
+		});
+	}
+});
+
+B(buffer_bulk_write, {
+	sig_buffer<float> buf(10000);
+	std::vector<float> values(10000);
+	float v = 0.0f;
+	for (auto _ : state) {
+		v += 1.0f;
+		std::fill(values.begin(), values.end(), v);
+		buf.assign(values);
+	}
+});
+
+B(buffer_sparse_write, {
+	sig_buffer<float> buf(10000);
+	float v = 0.0f;
+	for (auto _ : state) {
+		v += 1.0f;
+		buf.modify([&](float *values, std::size_t) {
+			values[1234] = v;
+		});
+	}
+});
+
+B(computation_tap, {
+	val<int> i(10);
+	int seen = 0;
+
+	sig_root root([=, &seen]() mutable {
+		S([=, &seen]() mutable {
+			seen = i;
+		});
+	});
+
+	int v = 20;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(i = (v ^= 1));
+	}
+	benchmark::DoNotOptimize(seen);
+});
+
+B(subscription_tap, {
+	val<int> i(10);
+	int seen = 0;
+
+	auto sub = i.subscribe([&seen](const int &, const int &new_value) {
+		seen = new_value;
+	});
+
+	int v = 20;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(i = (v ^= 1));
+	}
+	benchmark::DoNotOptimize(seen);
+});
+
+B(write_allocations, {
+	sig<int> i(10);
+	sig<int> j;
+
+	sig_root root([=]() mutable {
+		S([=]() mutable {
+			j = i * 10;
+		});
+		S([=]() mutable {
+			benchmark::DoNotOptimize(j + i);
+		});
+	});
+
+	int v = 0;
+	std::uint64_t before = S.stats().allocations;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(i = ++v);
+	}
+	report_allocations(state, before);
+});
+
+/* every write re-creates a nested computation and signal */
+B(nested_write_allocations, {
+	sig<int> i(10);
+
+	sig_root root([=]() mutable {
+		S([=]() mutable {
+			int x = i;
+			sig<int> inner(x);
+			S([=]() mutable {
+				benchmark::DoNotOptimize(inner + 1);
+			});
+		});
+	});
+
+	int v = 0;
+	std::uint64_t before = S.stats().allocations;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(i = ++v);
+	}
+	report_allocations(state, before);
+});
+
+/* a high-rate input with 64 consumers, read directly or through a throttle */
+B(high_rate_direct, {
+	sig<int> input(0);
+
+	sig_root root([=]() mutable {
+		for (int i = 0; i < 64; i++) {
+			S([=]() mutable { benchmark::DoNotOptimize(input + i); });
+		}
+	});
+
+	int v = 0;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(input = ++v);
+	}
+});
+
+B(high_rate_throttled, {
+	sig<int> input(0);
+	sig_timers timers;
+	auto throttled = S.throttle(input, std::chrono::milliseconds(16), timers);
+
+	sig_root root([=]() mutable {
+		for (int i = 0; i < 64; i++) {
+			S([=]() mutable { benchmark::DoNotOptimize(throttled + i); });
+		}
+	});
+
+	int v = 0;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(input = ++v);
+		if (timers.next_deadline() <= timers.now()) timers.poll();
+	}
+});
+
+/* the sum of 50k sources, one of which changes per write, rescanned or applied as a delta */
+B(aggregate_rescan, {
+	std::vector<val<double>> sources(50000);
+	sig<double> total;
+
+	sig_root root([=]() mutable {
+		S([=]() mutable {
+			double sum = 0;
+			for (auto &source : sources) sum += source;
+			total = sum;
+		});
+	});
+
+	std::size_t i = 0;
+	double v = 0;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(sources[i++ % sources.size()] = ++v);
+	}
+});
+
+B(aggregate_sum, {
+	std::vector<val<double>> sources(50000);
+	auto total = S.sum(sources);
+
+	sig_root root([=]() mutable {
+		S([=]() mutable { benchmark::DoNotOptimize(total + 0.0); });
+	});
+
+	std::size_t i = 0;
+	double v = 0;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(sources[i++ % sources.size()] = ++v);
+	}
+});
+
+B(aggregate_min, {
+	std::vector<val<double>> sources(50000);
+	auto lowest = S.min(sources);
+
+	sig_root root([=]() mutable {
+		S([=]() mutable { benchmark::DoNotOptimize(lowest + 0.0); });
+	});
+
+	std::size_t i = 0;
+	double v = 0;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(sources[i++ % sources.size()] = --v);
+	}
+});
+
+/*
+	A source feeding 64 computations, each also reading 15 static inputs
+	and feeding a 2nd-level computation; tracked or sealed.
+*/
+static void sealed_fanout(benchmark::State &state, bool seal) {
+	sig<int> input(0);
+	std::vector<sig<int>> statics(15);
+
+	sig_root root([=]() mutable {
+		for (int i = 0; i < 64; i++) {
+			sig<int> mid;
+			S([=]() mutable {
+				int sum = input + i;
+				for (auto &s : statics) sum += s;
+				mid = sum;
+			});
+			S([=]() mutable { benchmark::DoNotOptimize(mid + 0); });
+		}
+	});
+
+	if (seal) root.seal();
+
+	int v = 0;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(input = ++v);
+	}
+}
+
+B(fanout_tracked, {
+	sealed_fanout(state, false);
+});
+
+B(fanout_sealed, {
+	sealed_fanout(state, true);
+});
+
+/* 64 inputs summed by one computation, each written once per loop iteration */
+B(loop_direct_writes, {
+	std::vector<sig<int>> inputs(64);
+
+	sig_root root([=]() mutable {
+		S([=]() mutable {
+			int sum = 0;
+			for (auto &in : inputs) sum += in;
+			benchmark::DoNotOptimize(sum);
+		});
+	});
+
+	int v = 0;
+	for (auto _ : state) {
+		++v;
+		for (auto &in : inputs) in = v;
+	}
+});
+
+#ifdef LIBSIG_EVENTFD
+B(loop_bridge_writes, {
+	std::vector<sig<int>> inputs(64);
+	sig_bridge bridge;
+
+	sig_root root([=]() mutable {
+		S([=]() mutable {
+			int sum = 0;
+			for (auto &in : inputs) sum += in;
+			benchmark::DoNotOptimize(sum);
+		});
+	});
+
+	int v = 0;
+	for (auto _ : state) {
+		++v;
+		for (auto &in : inputs) bridge.post(in, v);
+		bridge.drain();
+	}
+});
+#endif
+
+/* an expensive pure function of an input flipping between 3 values, without and with a cache */
+static void memo_flip(benchmark::State &state, std::size_t capacity) {
+	sig<int> zoom(0);
+
+	auto tiles = S.memoize([=]() mutable {
+		double acc = 0;
+		int z = zoom;
+		for (int i = 0; i < 10000; i++) acc += (i % (z + 2)) * 0.5;
+		return acc;
+	}, capacity);
+
+	sig_root root([=]() mutable {
+		S([=]() mutable { benchmark::DoNotOptimize(tiles + 0.0); });
+	});
+
+	int v = 0;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(zoom = ++v % 3);
+	}
+	state.counters["hits"] = static_cast<double>(tiles.hits());
+	state.counters["misses"] = static_cast<double>(tiles.misses());
+}
+
+B(memo_flip_uncached, {
+	memo_flip(state, 0);
+});
+
+B(memo_flip_cached, {
+	memo_flip(state, 4);
+});
+
+/* a rarely written signal read by a fresh computation on every write to another */
+B(transient_readers, {
+	sig<int> config(1);
+	sig<int> trigger(0);
+
+	sig_root root([=]() mutable {
+		S([=]() mutable {
+			trigger.depend();
+			S([=]() mutable {
+				config.depend();
+			});
+		});
+	});
+
+	int v = 0;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(trigger = ++v);
+	}
+
+	state.counters["config_edges"] = static_cast<double>(config.observer_count());
+});
+
+/* one item of a 1000 item list changes; rebuild every child vs. keyed reuse */
+typedef std::pair<int, int> keyed_item;
+
+static std::vector<keyed_item> keyed_items() {
+	std::vector<keyed_item> items;
+	for (int i = 0; i < 1000; i++) items.push_back(keyed_item(i, 0));
+	return items;
+}
+
+B(list_rebuild_children, {
+	sig<std::vector<keyed_item>> list(keyed_items());
+
+	sig_root root([=]() mutable {
+		S([=]() mutable {
+			const std::vector<keyed_item> &items = list;
+			for (const keyed_item &i : items) {
+				int v = i.second;
+				S([v]() { benchmark::DoNotOptimize(v); });
+			}
+		});
+	});
+
+	std::vector<keyed_item> items = keyed_items();
+	for (auto _ : state) {
+		++items[500].second;
+		list = items;
+	}
+});
+
+B(list_map_keyed, {
+	sig<std::vector<keyed_item>> list(keyed_items());
+
+	sig_root root([=]() mutable {
+		S.map_keyed(list,
+			[](const keyed_item &i) { return i.first; },
+			[](val<keyed_item> &row) {
+				S([=]() mutable {
+					const keyed_item &i = row;
+					benchmark::DoNotOptimize(i.second);
+				});
+			});
+	});
+
+	std::vector<keyed_item> items = keyed_items();
+	for (auto _ : state) {
+		++items[500].second;
+		list = items;
+	}
+});
+
+/*
+	A computation reading one signal many times per run, re-run by a
+	write to a separate trigger; isolates the per-read tracking cost.
+*/
+template <typename Policy>
+static void BM_policy_tracked_reads(benchmark::State &state) {
+	sig<int, Policy> s(1);
+	sig<int> trigger;
+
+	sig_root root([=]() mutable {
+		S([=]() mutable {
+			trigger.depend();
+			int sum = 0;
+			for (int i = 0; i < 64; i++) sum += s;
+			benchmark::DoNotOptimize(sum);
+		});
+	});
+
+	int v = 0;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(trigger = ++v);
+	}
+}
+BENCHMARK_TEMPLATE(BM_policy_tracked_reads, sig_policy<>);
+BENCHMARK_TEMPLATE(BM_policy_tracked_reads, sig_policy<true, false>);
+BENCHMARK_TEMPLATE(BM_policy_tracked_reads, sig_policy<false, true>);
+BENCHMARK_TEMPLATE(BM_policy_tracked_reads, sig_policy<false, false>);
+
+/* repeated writes within one batch; conflict checks vs last-write-wins */
+template <typename Policy>
+static void BM_policy_batched_writes(benchmark::State &state) {
+	sig<int, Policy> s;
+
+	int v = 0;
+	for (auto _ : state) {
+		++v;
+		S.freeze([&] {
+			for (int i = 0; i < 64; i++) s = v;
+		});
+	}
+}
+BENCHMARK_TEMPLATE(BM_policy_batched_writes, sig_policy<>);
+BENCHMARK_TEMPLATE(BM_policy_batched_writes, sig_policy<true, true, false>);
+
+/*
+	Wires 10 layers of 100 computations (each reading three signals of the
+	layer before it) and only then gives the 100 sources their values,
+	either as they come, within one S.freeze(), or within S.build().
+*/
+enum build_mode { build_immediate, build_frozen, build_bulk };
+
+template <build_mode Mode>
+static void BM_graph_build(benchmark::State &state) {
+	std::uint64_t updates = 0;
+
+	for (auto _ : state) {
+		std::vector<std::unique_ptr<sig<int>>> signals;
+
+		auto wire = [&] {
+			for (int i = 0; i < 100; i++) {
+				signals.emplace_back(new sig<int>());
+			}
+
+			for (int layer = 0; layer < 10; layer++) {
+				std::size_t base = signals.size() - 100;
+				for (std::size_t i = 0; i < 100; i++) {
+					sig<int> a(*signals[base + i]);
+					sig<int> b(*signals[base + (i + 1) % 100]);
+					sig<int> c(*signals[base + (i + 37) % 100]);
+					signals.emplace_back(new sig<int>());
+					sig<int> out(*signals.back());
+					S([=]() mutable { out = a + b + c; });
+				}
+			}
+
+			for (int i = 0; i < 100; i++) {
+				*signals[i] = i;
+			}
+		};
+
+		sig_root root([&] {
+			if (Mode == build_bulk) {
+				S.build(wire);
+			} else if (Mode == build_frozen) {
+				S.freeze(wire);
+			} else {
+				wire();
+			}
+		});
+
+		updates = root.stats().updates;
+	}
+
+	state.counters["updates"] = static_cast<double>(updates);
+}
+BENCHMARK_TEMPLATE(BM_graph_build, build_immediate)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_graph_build, build_frozen)->Unit(benchmark::kMicrosecond);
+BENCHMARK_TEMPLATE(BM_graph_build, build_bulk)->Unit(benchmark::kMicrosecond);
+
+/*
+	Heap bytes (and allocations) per node for a graph of `range(0)`
+	signals and as many computations, each reading three signals.
+*/
+static void BM_memory_per_node(benchmark::State &state) {
+	std::size_t n = static_cast<std::size_t>(state.range(0));
+	std::size_t bytes = 0;
+	std::size_t allocs = 0;
+
+	for (auto _ : state) {
+		std::vector<std::unique_ptr<sig<int>>> signals;
+		signals.reserve(n);
+
+		/* both signals and computations are counted */
+		std::size_t bytes_before = allocated_bytes.load(std::memory_order_relaxed);
+		std::size_t allocs_before = allocation_count.load(std::memory_order_relaxed);
+
+		for (std::size_t i = 0; i < n; i++) {
+			signals.emplace_back(new sig<int>(static_cast<int>(i)));
+		}
+
+		sig_root root([&] {
+			for (std::size_t i = 0; i < n; i++) {
+				sig<int> a(*signals[i]);
+				sig<int> b(*signals[(i + 1) % n]);
+				sig<int> c(*signals[(i + 7) % n]);
+				S([=]() mutable {
+					benchmark::DoNotOptimize(a + b + c);
+				});
+			}
+		});
+
+		bytes = allocated_bytes.load(std::memory_order_relaxed) - bytes_before;
+		allocs = allocation_count.load(std::memory_order_relaxed) - allocs_before;
+	}
+
+	state.counters["bytes_per_node"] = static_cast<double>(bytes) / static_cast<double>(2 * n);
+	state.counters["allocs_per_node"] = static_cast<double>(allocs) / static_cast<double>(2 * n);
+}
+BENCHMARK(BM_memory_per_node)->Arg(1 << 10)->Arg(1 << 20)->Iterations(1)->Unit(benchmark::kMillisecond);
+
 BENCHMARK_MAIN();
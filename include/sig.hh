@@ -19,103 +19,836 @@
 	            MIT License
 */
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <deque>
+#include <exception>
 #include <functional>
+#include <istream>
+#include <iterator>
 #include <list>
+#include <map>
 #include <memory>
 #include <ostream>
-#include <set>
 #include <stdexcept>
+#include <string>
+#include <type_traits>
 #include <utility>
+#include <vector>
+
+#ifdef _MSC_VER
+#	include <intrin.h>
+#endif
+
+#ifdef LIBSIG_ALLOC_STATS
+#	include <new>
+#endif
+
+#if defined(LIBSIG_SHM) && defined(LIBSIG_NO_EXCEPTIONS)
+#	error "LIBSIG_SHM requires exceptions"
+#endif
+
+#ifdef LIBSIG_SHM
+#	include <cerrno>
+#	include <system_error>
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+#if defined(LIBSIG_EVENTFD) && defined(LIBSIG_NO_EXCEPTIONS)
+#	error "LIBSIG_EVENTFD requires exceptions"
+#endif
+
+#ifdef LIBSIG_EVENTFD
+#	include <cerrno>
+#	include <mutex>
+#	include <system_error>
+#	include <sys/eventfd.h>
+#	include <unistd.h>
+#endif
 
 #ifndef LIBSIG_RUNAWAYTHRESH
 #	define LIBSIG_RUNAWAYTHRESH 1000
 #endif
 
+#ifndef LIBSIG_COMPACTTHRESH
+#	define LIBSIG_COMPACTTHRESH 64
+#endif
+
+/*
+	LIBSIG_HEAP_FREE_AFTER_BUILD makes a graph heap-free once it's been
+	constructed: observer lists, the children of roots and computations,
+	and the clock's schedule (and deferred effects) are capped at the
+	sizes below and preallocated, so writes and propagation through
+	signals, computations, derived signals, buffers, stores, selectors
+	and aggregates never allocate, and every pass is bounded. Going over
+	a cap is reported as `error_capacity`.
+
+	This isn't static storage. Nodes, their shared_ptr control blocks
+	and their std::functions are allocated when they're created, as is
+	the first read of a buffer element, store field or selector key.
+	Timers, memo caches and keyed maps allocate as they run.
+*/
+#ifdef LIBSIG_HEAP_FREE_AFTER_BUILD
+#	ifndef LIBSIG_MAXOBSERVERS
+#		define LIBSIG_MAXOBSERVERS 8
+#	endif
+#	ifndef LIBSIG_MAXCHILDREN
+#		define LIBSIG_MAXCHILDREN 16
+#	endif
+#	ifndef LIBSIG_MAXROOTCHILDREN
+#		define LIBSIG_MAXROOTCHILDREN 256
+#	endif
+#	ifndef LIBSIG_MAXSCHEDULED
+#		define LIBSIG_MAXSCHEDULED 1024
+#	endif
+#endif
+
+/*
+	With LIBSIG_NO_EXCEPTIONS, errors are passed to the handler set with
+	`libsig::set_error_handler()` (the default aborts) instead of being
+	thrown. If the handler returns, the failing operation is abandoned
+	as documented where it's raised.
+*/
+#ifdef LIBSIG_NO_EXCEPTIONS
+#	define LIBSIG_FAIL(code, type, what) ::libsig::detail::report_error(::libsig::detail::code, what)
+#else
+#	define LIBSIG_FAIL(code, type, what) throw type(what)
+#endif
+
 namespace libsig {
 namespace detail {
 
 	typedef unsigned long long age_t;
 
+	enum error_code {
+		error_runaway,
+		error_conflict,
+		error_out_of_range,
+		error_no_owner,
+		error_duplicate_key,
+		error_invalid_argument,
+		error_capacity,
+		error_sealed
+	};
+
+	typedef void (*error_handler)(error_code code, const char *what);
+
+#ifdef LIBSIG_MAIN
+	error_handler current_error_handler = nullptr;
+#else
+	extern error_handler current_error_handler;
+#endif
+
+	inline void report_error(error_code code, const char *what) {
+		if (current_error_handler) {
+			current_error_handler(code, what);
+		} else {
+			std::abort();
+		}
+	}
+
+	/* returns the previous handler */
+	inline error_handler set_error_handler(error_handler handler) {
+		error_handler prev = current_error_handler;
+		current_error_handler = handler;
+		return prev;
+	}
+
+	/* index of the lowest set bit; `v` must be non-zero */
+	inline unsigned ctz64(std::uint64_t v) {
+#ifdef _MSC_VER
+		unsigned long i;
+		_BitScanForward64(&i, v);
+		return static_cast<unsigned>(i);
+#else
+		return static_cast<unsigned>(__builtin_ctzll(v));
+#endif
+	}
+
+	/*
+		A vector that keeps its first N elements inline and only moves to
+		the heap once it outgrows them. Clearing keeps the storage.
+	*/
+	template <typename T, std::size_t N>
+	class small_vector {
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type inline_storage[N];
+		T *first;
+		std::uint32_t count;
+		std::uint32_t cap;
+
+		inline bool is_inline() const
+			{ return first == reinterpret_cast<const T *>(inline_storage); }
+
+		void grow()
+			{ reserve(cap * 2); }
+
+	public:
+		typedef T value_type;
+		typedef T * iterator;
+		typedef const T * const_iterator;
+
+		small_vector()
+		: first(reinterpret_cast<T *>(inline_storage))
+		, count(0)
+		, cap(N)
+		{}
+
+		small_vector(small_vector &&other)
+		: small_vector()
+		{
+			if (other.is_inline()) {
+				for (std::uint32_t i = 0; i < other.count; i++) {
+					push_back(std::move(other.first[i]));
+				}
+				other.clear();
+			} else {
+				first = other.first;
+				count = other.count;
+				cap = other.cap;
+				other.first = reinterpret_cast<T *>(other.inline_storage);
+				other.count = 0;
+				other.cap = N;
+			}
+		}
+
+		small_vector(const small_vector &) = delete;
+		small_vector & operator =(const small_vector &) = delete;
+
+		~small_vector() {
+			clear();
+			if (!is_inline()) ::operator delete(first);
+		}
+
+		inline void push_back(const T &v) {
+			if (count == cap) grow();
+			new (&first[count++]) T(v);
+		}
+
+		inline void push_back(T &&v) {
+			if (count == cap) grow();
+			new (&first[count++]) T(std::move(v));
+		}
+
+		void reserve(std::size_t n) {
+			if (n <= cap) return;
+			T *next = static_cast<T *>(::operator new(n * sizeof(T)));
+			for (std::uint32_t i = 0; i < count; i++) {
+				new (&next[i]) T(std::move(first[i]));
+				first[i].~T();
+			}
+			if (!is_inline()) ::operator delete(first);
+			first = next;
+			cap = static_cast<std::uint32_t>(n);
+		}
+
+		inline void clear() {
+			for (std::uint32_t i = 0; i < count; i++) first[i].~T();
+			count = 0;
+		}
+
+		inline iterator erase(iterator from, iterator to) {
+			iterator out = std::move(to, end(), from);
+			for (iterator i = out; i != end(); ++i) i->~T();
+			count = static_cast<std::uint32_t>(out - first);
+			return from;
+		}
+
+		inline iterator begin() { return first; }
+		inline iterator end() { return first + count; }
+		inline const_iterator begin() const { return first; }
+		inline const_iterator end() const { return first + count; }
+
+		inline T & back() { return first[count - 1]; }
+		inline std::size_t size() const { return count; }
+		inline std::size_t capacity() const { return cap; }
+		inline bool empty() const { return count == 0; }
+	};
+
+	class clock;
+
+	enum node_kind {
+		node_signal,
+		node_computation,
+		node_derived,
+		node_selector,
+		node_buffer,
+		node_store,
+		node_keyed_map,
+		node_publisher,
+		node_timed,
+		node_effect,
+		node_aggregate,
+		node_memo,
+		node_kind_count
+	};
+
+	struct sealed_graph;
+
 	struct node {
 		bool stale;
+		std::uint8_t kind;
+		/* whether this node's last run threw; see `clock::run` */
+		bool failed;
+		/* whether owners never adopt this node (e.g. signals with ownership off); see `sealable` */
+		bool unowned;
+
+		/* the number of observer edges this node holds; see `clock_stats` */
+		std::uint32_t edges;
+
+		/* the generation of the owner that last adopted this node; see `owner` */
+		std::uint64_t adopted_gen;
+
+		/* the sealed graph this node belongs to, if any, and its slot in it */
+		sealed_graph *sealed;
+		std::uint32_t sealed_index;
 
 		std::function<void()> update;
 
-		node()
-		: stale(true)
-		{}
+		/* the clock this node schedules itself on outside of a batch */
+		std::shared_ptr<clock> home;
+
+		explicit node(node_kind k);
+		~node();
 
 		node(const node &) = delete;
 		node(node &&) = delete;
 	};
 
+#ifdef LIBSIG_HEAP_FREE_AFTER_BUILD
+	typedef small_vector<std::weak_ptr<node>, LIBSIG_MAXOBSERVERS> observer_list;
+	typedef small_vector<std::shared_ptr<node>, LIBSIG_MAXCHILDREN> child_list;
+#else
+	typedef small_vector<std::weak_ptr<node>, 2> observer_list;
+	typedef small_vector<std::shared_ptr<node>, 4> child_list;
+#endif
+
+	/*
+		Nodes keeping observers in more than one list (per element, field
+		or key) aren't sealed, nor are nodes no owner adopts, which a
+		root can't find when it's sealed.
+	*/
+	inline bool sealable(const node &n) {
+		return !n.unowned
+			&& n.kind != node_buffer
+			&& n.kind != node_store
+			&& n.kind != node_selector
+			&& n.kind != node_keyed_map;
+	}
+
+	/*
+		The fixed adjacency of a sealed root (see `signal_root::seal`), as
+		one flat array of observers with a [begin, end) range per node.
+		A node's range is moved out of its observer list the first time
+		it propagates after sealing; from then on, it's walked directly
+		and never consumed, until `release()` moves it back.
+	*/
+	struct sealed_graph {
+		struct range {
+			std::uint32_t begin;
+			std::uint32_t end;
+			bool built;
+			/* the list the range was moved out of */
+			observer_list *source;
+		};
+
+		std::vector<std::weak_ptr<node>> nodes;
+		std::vector<range> ranges;
+		std::vector<std::weak_ptr<node>> targets;
+
+		sealed_graph() = default;
+		sealed_graph(const sealed_graph &) = delete;
+
+		~sealed_graph()
+			{ release(); }
+
+		/* a node can only belong to one sealed graph */
+		inline bool add(const std::shared_ptr<node> &n) {
+			if (n->sealed || !sealable(*n)) return false;
+			n->sealed = this;
+			n->sealed_index = static_cast<std::uint32_t>(nodes.size());
+			nodes.push_back(n);
+			ranges.push_back(range{0, 0, false, nullptr});
+			return true;
+		}
+
+		/* moves the observers that belong to this graph out of `observers` */
+		inline range & build(std::uint32_t index, observer_list &observers) {
+			range &r = ranges[index];
+			r.begin = static_cast<std::uint32_t>(targets.size());
+
+			auto out = observers.begin();
+			for (auto &o : observers) {
+				auto op = o.lock();
+				if (!op) continue;
+
+				if (op->sealed == this) {
+					targets.push_back(std::move(o));
+				} else {
+					if (&*out != &o) *out = std::move(o);
+					++out;
+				}
+			}
+			observers.erase(out, observers.end());
+
+			r.end = static_cast<std::uint32_t>(targets.size());
+			r.built = true;
+			r.source = &observers;
+			return r;
+		}
+
+		/*
+			Moves each built range back into the observer list it came
+			from, and lets go of every node. The edges stay counted by
+			their holders throughout; see `clock_stats`.
+		*/
+		inline void release();
+
+		/* whether `o` observes `holder` as of sealing; used by debug builds */
+		inline bool has_edge(const node &holder, const observer_list &observers, const std::shared_ptr<node> &o) const {
+			const range &r = ranges[holder.sealed_index];
+			const std::weak_ptr<node> *begin = r.built ? targets.data() + r.begin : observers.begin();
+			const std::weak_ptr<node> *end = r.built ? targets.data() + r.end : observers.end();
+			for (; begin != end; ++begin) {
+				if (!begin->owner_before(o) && !o.owner_before(*begin)) return true;
+			}
+			return false;
+		}
+	};
+
+	/*
+		Drops expired and repeated entries from an observer list, keeping
+		the first occurrence of each observer in order.
+	*/
+#ifdef LIBSIG_HEAP_FREE_AFTER_BUILD
+	/* lists are at most LIBSIG_MAXOBSERVERS long; compacted in place */
+	inline void compact_observers(observer_list &observers) {
+		auto out = observers.begin();
+		for (auto &o : observers) {
+			if (o.expired()) continue;
+
+			bool seen = false;
+			for (auto k = observers.begin(); k != out; ++k) {
+				if (!k->owner_before(o) && !o.owner_before(*k)) {
+					seen = true;
+					break;
+				}
+			}
+			if (seen) continue;
+
+			if (&*out != &o) *out = std::move(o);
+			++out;
+		}
+		observers.erase(out, observers.end());
+	}
+#else
+	inline void compact_observers(observer_list &observers) {
+		std::size_t n = observers.size();
+		auto *o = observers.begin();
+
+		std::vector<std::size_t> order(n);
+		for (std::size_t i = 0; i < n; i++) order[i] = i;
+		std::stable_sort(order.begin(), order.end(), [o](std::size_t a, std::size_t b) {
+			return o[a].owner_before(o[b]);
+		});
+
+		std::vector<bool> keep(n, true);
+		for (std::size_t i = 0; i < n; i++) {
+			if (o[order[i]].expired()) {
+				keep[order[i]] = false;
+			} else if (i > 0 && !o[order[i - 1]].owner_before(o[order[i]])) {
+				keep[order[i]] = false;
+			}
+		}
+
+		std::size_t out = 0;
+		for (std::size_t i = 0; i < n; i++) {
+			if (keep[i]) {
+				if (out != i) o[out] = std::move(o[i]);
+				++out;
+			}
+		}
+		observers.erase(observers.begin() + out, observers.end());
+	}
+#endif
+
+	/*
+		Children are kept in a flat list. Each owner takes a process-wide
+		unique generation whenever its children are cleared, and a node
+		remembers the generation that last adopted it, so reading the same
+		node repeatedly from one owner only adopts it once.
+
+		Generations only grow, and an owner only adopts while it runs, so
+		a node stamped by a newer generation was adopted by an owner that
+		was created or run within this one's run (e.g. a computation's
+		first run within a root's constructor). Only then is the list
+		searched, since this owner may have adopted the node before.
+	*/
+	inline std::uint64_t next_owner_generation() {
+		static std::atomic<std::uint64_t> generation(0);
+		return generation.fetch_add(1, std::memory_order_relaxed) + 1;
+	}
+
 	struct owner {
-		std::set<std::shared_ptr<node>> children;
+		child_list children;
+		std::uint64_t gen;
+
+		owner()
+		: gen(next_owner_generation())
+		{}
 
-		owner() = default;
 		owner(const owner &) = delete;
 		owner(owner &&) = delete;
+
+		/* whether another child fits; with fixed capacities, the child is not kept otherwise */
+		inline bool has_room() {
+#ifdef LIBSIG_HEAP_FREE_AFTER_BUILD
+			if (children.size() == children.capacity()) {
+				LIBSIG_FAIL(error_capacity, std::length_error, "owner child capacity exceeded");
+				return false;
+			}
+#endif
+			return true;
+		}
+
+		/* whether `n` is a child already */
+		inline bool adopted(node &n) const {
+			if (n.adopted_gen <= gen) return n.adopted_gen == gen;
+
+			for (auto &c : children) {
+				if (c.get() == &n) {
+					n.adopted_gen = gen;
+					return true;
+				}
+			}
+			return false;
+		}
+
+		inline void adopt(const std::shared_ptr<node> &n) {
+			if (adopted(*n) || !has_room()) return;
+			n->adopted_gen = gen;
+			children.push_back(n);
+		}
+
+		/* adopts `n`, only locking `self` if it isn't a child already */
+		template <typename N>
+		inline void adopt(N &n, const std::weak_ptr<N> &self) {
+			if (adopted(n) || !has_room()) return;
+			if (auto p = self.lock()) {
+				n.adopted_gen = gen;
+				children.push_back(std::move(p));
+			}
+		}
+
+		inline void release_children() {
+			gen = next_owner_generation();
+			children.clear();
+		}
+	};
+
+	/*
+		Counters kept by every clock; see `clock::stats`. They're plain
+		integers, updated by whichever thread creates or destroys a node
+		bound to the clock, or drives (and allocates within) it, so like
+		the clock itself they must only be touched by one thread at a
+		time. Nodes created outside of any root count against the
+		creating thread's default clock, so they shouldn't be destroyed
+		on another thread while that one is still at work.
+	*/
+	struct clock_stats {
+		/* live nodes bound to the clock, by `node_kind` */
+		std::size_t nodes[node_kind_count];
+		/* observer edges held by those nodes, including those moved into a sealed graph */
+		std::size_t edges;
+		/* passes through the schedule, and node updates run by them */
+		std::uint64_t ticks;
+		std::uint64_t updates;
+		/*
+			Allocations reported by `note_allocation` while the clock was
+			running or frozen, and their bytes, since the clock was made.
+			Frees aren't tracked, so this isn't the heap the graph holds.
+		*/
+		std::uint64_t allocations;
+		std::uint64_t allocated_bytes_total;
+		/* node updates that threw */
+		std::uint64_t errors;
+
+		clock_stats()
+		: nodes()
+		, edges(0)
+		, ticks(0)
+		, updates(0)
+		, allocations(0)
+		, allocated_bytes_total(0)
+		, errors(0)
+		{}
+
+		inline std::size_t live_nodes() const {
+			std::size_t n = 0;
+			for (std::size_t k : nodes) n += k;
+			return n;
+		}
+	};
+
+	/*
+		Observes writes and freeze boundaries made on a thread, whichever
+		clock they go to; see `recorder`.
+	*/
+	struct clock_tap {
+		virtual ~clock_tap() = default;
+		virtual void on_write(const node *n, const void *value) = 0;
+		virtual void on_freeze() = 0;
+		virtual void on_thaw() = 0;
 	};
 
+	class subscription;
+
+	/* handles an exception thrown by a node update; see `clock::run` */
+	typedef std::function<void(std::exception_ptr)> error_boundary;
+
+	/*
+		Every sig_root owns a clock, and every node remembers the clock
+		of the root it was created in (or the thread's default clock when
+		created outside of one). A write made while no clock is running
+		or frozen on the current thread starts a batch on the written
+		node's clock; everything scheduled during that batch (including
+		nodes of other roots) is then processed by that same clock.
+
+		Graphs with separate clocks can thus be driven independently, and
+		a root may be handed to another thread as long as only one thread
+		drives its clock at a time.
+	*/
 	class clock {
 		friend struct freeze_guard;
 
 		age_t current_time;
 		int frozen;
-		std::list<std::weak_ptr<node>> scheduled;
+		/* whether `settle()` is running; see `settling()` */
+		bool in_settle;
+		std::vector<std::weak_ptr<node>> scheduled;
+		/* the pass being run; kept so its storage is reused by the next one */
+		std::vector<std::weak_ptr<node>> running;
+		/* effects reached during the current batch; see `settle()` */
+		std::vector<std::weak_ptr<node>> effects;
 
-		inline void event() {
-			if (frozen) return;
-			auto fg = freeze<false>();
+		struct settled_listener {
+			std::function<void()> fn;
+		};
 
-			age_t start_time = current_time;
+		std::list<std::weak_ptr<settled_listener>> settled;
+
+#ifndef LIBSIG_NO_EXCEPTIONS
+		/* the first exception of the batch that no boundary handled; see `run()` */
+		std::exception_ptr unhandled;
+#endif
+
+	public:
+		clock_stats stats;
+		/* handles exceptions thrown by nodes bound to this clock, if set */
+		error_boundary on_error;
 
+	private:
+
+		/*
+			Runs passes until nothing is left scheduled, counting them
+			against the runaway budget from `start_time`. Effects are set
+			aside rather than run. The clock must be frozen; returns false
+			if the budget ran out.
+		*/
+		inline bool drain(age_t start_time) {
 			while (scheduled.size()) {
-				auto next = scheduled;
-				scheduled.clear();
+				running.clear();
+				running.swap(scheduled);
 
 				if ((++current_time) - start_time > LIBSIG_RUNAWAYTHRESH) {
-					throw std::logic_error("runaway clock detected");
+					/* whatever is still scheduled is dropped */
+					scheduled.clear();
+					effects.clear();
+#ifndef LIBSIG_NO_EXCEPTIONS
+					unhandled = nullptr;
+#endif
+					LIBSIG_FAIL(error_runaway, std::logic_error, "runaway clock detected");
+					return false;
 				}
 
-				for (auto &n : next) {
-					if (auto np = n.lock()) {
-						np->update();
+				++stats.ticks;
+				for (std::size_t i = 0; i < running.size(); i++) {
+					if (auto np = running[i].lock()) {
+						if (np->kind == node_effect) {
+							defer_effect(std::move(running[i]));
+							continue;
+						}
+
+						run(*np);
 					}
 				}
 			}
+
+			return true;
 		}
 
-	public:
-		template <bool RaiseEvent = true>
-		struct freeze_guard {
-			clock *c;
+		/*
+			Updates `n`. If that throws, the node is marked failed, its
+			observers aren't notified, and the exception goes to the
+			`on_error` boundary of the clock the node is bound to; either
+			way, the batch carries on. Without a
+			boundary, the first such exception is kept and rethrown once
+			the batch has settled (see `settle()`), from whichever write,
+			freeze or build started it; any later ones are only counted.
+		*/
+		inline void run(node &n) {
+			++stats.updates;
+#ifdef LIBSIG_NO_EXCEPTIONS
+			n.update();
+#else
+			try {
+				n.update();
+			} catch (...) {
+				n.failed = true;
+				++n.home->stats.errors;
+
+				if (n.home->on_error) {
+					n.home->on_error(std::current_exception());
+				} else if (!unhandled) {
+					unhandled = std::current_exception();
+				}
+			}
+#endif
+		}
+
+		/*
+			Drains, then runs the effects that were reached, once each, on
+			the settled values; anything they write is drained before the
+			next round. Once nothing is left, `on_settled` listeners are
+			called if any work was done, and anything they write starts
+			another round, all within the same runaway budget. Finally, an
+			exception no boundary handled is rethrown.
+		*/
+		inline void settle() {
+			struct settle_guard {
+				bool &flag;
+				settle_guard(bool &f) : flag(f) { flag = true; }
+				~settle_guard() { flag = false; }
+			} sg(in_settle);
+
+			age_t start_time = current_time;
+			age_t settled_time = start_time;
 
-			freeze_guard(clock *_c)
-			: c(_c)
-			{ ++c->frozen; }
+			for (;;) {
+				if (!drain(start_time)) return;
 
-			freeze_guard(const freeze_guard &other)
-			: c(other.c)
-			{ ++c->frozen; }
+				if (!effects.empty()) {
+					running.clear();
+					running.swap(effects);
+					for (auto &n : running) {
+						if (auto np = n.lock()) {
+							run(*np);
+						}
+					}
+					continue;
+				}
+
+				if (current_time == settled_time) break;
+				settled_time = current_time;
 
-			~freeze_guard() {
-				if (RaiseEvent) { /* optimized out */
-					if (--c->frozen == 0) {
-						c->event();
+				for (auto itr = settled.begin(); itr != settled.end();) {
+					if (auto lp = itr->lock()) {
+						lp->fn();
+						++itr;
+					} else {
+						itr = settled.erase(itr);
 					}
-				} else {
-					--c->frozen;
 				}
 			}
+
+#ifndef LIBSIG_NO_EXCEPTIONS
+			if (unhandled) {
+				std::exception_ptr ep = std::move(unhandled);
+				unhandled = nullptr;
+				std::rethrow_exception(ep);
+			}
+#endif
+		}
+
+		inline void event() {
+			if (frozen) return;
+			auto fg = freeze<false>();
+			settle();
+		}
+
+		inline void enqueue(std::weak_ptr<node> &&n) {
+#ifdef LIBSIG_HEAP_FREE_AFTER_BUILD
+			if (scheduled.size() == LIBSIG_MAXSCHEDULED) {
+				/* the node isn't updated */
+				LIBSIG_FAIL(error_capacity, std::length_error, "schedule capacity exceeded");
+				return;
+			}
+#endif
+			scheduled.push_back(std::move(n));
+		}
+
+		inline void defer_effect(std::weak_ptr<node> &&n) {
+#ifdef LIBSIG_HEAP_FREE_AFTER_BUILD
+			if (effects.size() == LIBSIG_MAXSCHEDULED) {
+				/* the effect isn't run */
+				LIBSIG_FAIL(error_capacity, std::length_error, "effect capacity exceeded");
+				return;
+			}
+#endif
+			effects.push_back(std::move(n));
+		}
+
+		inline void reserve_schedule() {
+#ifdef LIBSIG_HEAP_FREE_AFTER_BUILD
+			scheduled.reserve(LIBSIG_MAXSCHEDULED);
+			running.reserve(LIBSIG_MAXSCHEDULED);
+			effects.reserve(LIBSIG_MAXSCHEDULED);
+#endif
+		}
+
+		/* signals and other nodes whose update applies a written value */
+		static inline bool applies_write(const node &n) {
+			return n.kind == node_signal
+				|| n.kind == node_buffer
+				|| n.kind == node_store
+				|| n.kind == node_timed;
+		}
+
+	public:
+		/*
+			Holds the clock frozen and makes it the thread's active clock,
+			so all writes within its lifetime are batched onto it.
+		*/
+		template <bool RaiseEvent = true>
+		struct freeze_guard {
+			clock *c;
+			clock *prev;
+
+			freeze_guard(clock *_c);
+			freeze_guard(freeze_guard &&other);
+			/* thawing runs the batch, which may rethrow; see `run()` */
+			~freeze_guard() noexcept(false);
+
+			freeze_guard(const freeze_guard &) = delete;
 		};
 
 		clock()
 		: current_time(1ull) /* must start at 1 since all computations start at 0 */ /* XXX this might not be the case after all */
 		, frozen(0)
-		{}
+		, in_settle(false)
+		{
+			reserve_schedule();
+		}
+
+		clock(const clock &) = delete;
+		clock(clock &&) = delete;
 
 		template <bool RaiseEvent>
 		inline freeze_guard<RaiseEvent> freeze()
@@ -124,6 +857,31 @@ namespace detail {
 		inline age_t time() const
 			{ return current_time; }
 
+		/*
+			Whether a batch is being settled, so that writes made now come
+			from the graph itself (computations, effects, listeners) rather
+			than from outside of it.
+		*/
+		inline bool settling() const
+			{ return in_settle; }
+
+		/* calls `fn` each time a batch on this clock has settled, until the subscription is dropped */
+		inline subscription on_settled(std::function<void()> fn);
+
+		/*
+			Schedules the sealed observers in [begin, end), which are kept,
+			then consumes and schedules `observers` as usual.
+		*/
+		inline void schedule_sealed(const std::weak_ptr<node> *begin, const std::weak_ptr<node> *end, observer_list &observers) {
+			for (; begin != end; ++begin) {
+				if (auto op = begin->lock()) {
+					op->stale = true;
+					enqueue(std::weak_ptr<node>(*begin));
+				}
+			}
+			consume_and_schedule_all(observers);
+		}
+
 		/*
 			WARNING: like the name suggests, this consumes (clears) all elements
 			         from the `observers` collection.
@@ -134,36 +892,328 @@ namespace detail {
 				if (auto op = observer.lock()) {
 					op->stale = true;
 				}
+				enqueue(std::move(observer));
 			}
-			scheduled.splice(scheduled.end(), observers);
+			observers.clear();
 			event();
 		}
 
 		inline void schedule_one(std::weak_ptr<node> n) {
-			scheduled.push_back(n);
+			enqueue(std::move(n));
 			event();
 		}
-	};
 
-	struct system_state {
-		clock root_clock;
-		std::shared_ptr<owner> current_owner;
-		std::shared_ptr<node> observer;
-	};
+		/*
+			Runs `fn` with the clock frozen, then evaluates everything it
+			scheduled: the values it wrote are applied and drained first,
+			then each computation it created is run in creation order (not
+			in dependency order), draining its writes before the next one
+			runs, all on this thread. A computation only runs once if the
+			ones it reads from were created before it; otherwise it's run
+			again when they write. Effects run once the whole graph has
+			settled. If the clock is already frozen, `fn` is batched onto
+			it as usual.
+		*/
+		template <typename Fn>
+		void build(Fn fn) {
+			if (frozen) {
+				fn();
+				return;
+			}
 
-#ifdef LIBSIG_MAIN
-	thread_local system_state system;
-#else
-	extern thread_local system_state system;
-#endif
+			auto fg = freeze<true>();
+			fn();
 
-	struct owner_guard {
-		std::shared_ptr<owner> prev;
+			std::vector<std::weak_ptr<node>> pending;
+			pending.swap(scheduled);
+			reserve_schedule();
 
-		owner_guard(std::shared_ptr<owner> p)
-		: prev(system.current_owner)
-		{
-			system.current_owner = p;
+			++current_time;
+			++stats.ticks;
+			for (auto &n : pending) {
+				auto np = n.lock();
+				if (np && applies_write(*np)) {
+					run(*np);
+				}
+			}
+			drain(current_time);
+
+			/* effects are set aside until the whole graph has been built */
+			for (auto &n : pending) {
+				auto np = n.lock();
+				if (!np || applies_write(*np)) continue;
+
+				if (np->kind == node_effect) {
+					defer_effect(std::move(n));
+				} else {
+					run(*np);
+					drain(current_time);
+				}
+			}
+
+			settle();
+		}
+	};
+
+	/*
+		A signal read during a memoized run (see `memo`), along with the
+		value it had.
+	*/
+	struct memo_read {
+		virtual ~memo_read() = default;
+		/* whether the signal still holds the value it had when read */
+		virtual bool unchanged() const = 0;
+		/* subscribes the current observer to the signal again */
+		virtual void depend() = 0;
+	};
+
+	struct memo_recorder {
+		/* the memo whose reads are recorded */
+		const node *reader;
+		std::vector<std::unique_ptr<memo_read>> reads;
+		/* the last node recorded, so repeated reads are only recorded once */
+		const node *last;
+		/* false once anything but a signal has been read */
+		bool cacheable;
+
+		memo_recorder(const node *_reader)
+		: reader(_reader)
+		, last(nullptr)
+		, cacheable(true)
+		{}
+	};
+
+	struct system_state {
+		/* the default clock for nodes created outside of any root */
+		std::shared_ptr<clock> root_clock;
+		/* the clock currently running or frozen on this thread, if any */
+		clock *active;
+		/* the clock new nodes are bound to, if not the default */
+		std::shared_ptr<clock> context;
+		std::shared_ptr<owner> current_owner;
+		std::shared_ptr<node> observer;
+		/* the reads of the memoized run in progress, if any */
+		memo_recorder *recording;
+		/* sees every write and freeze made on this thread, if set */
+		clock_tap *tap;
+
+		system_state()
+		: root_clock(std::make_shared<clock>())
+		, active(nullptr)
+		, recording(nullptr)
+		, tap(nullptr)
+		{}
+	};
+
+#ifdef LIBSIG_MAIN
+	thread_local system_state system;
+	/* mirrors `system.active`, but is safe to read from within operator new */
+	thread_local clock *allocating_clock = nullptr;
+#else
+	extern thread_local system_state system;
+	extern thread_local clock *allocating_clock;
+#endif
+
+	inline node::node(node_kind k)
+	: stale(true)
+	, kind(static_cast<std::uint8_t>(k))
+	, failed(false)
+	, unowned(false)
+	, edges(0)
+	, adopted_gen(0)
+	, sealed(nullptr)
+	, sealed_index(0)
+	, home(system.context ? system.context : system.root_clock)
+	{
+		++home->stats.nodes[kind];
+	}
+
+	inline node::~node() {
+		--home->stats.nodes[kind];
+		home->stats.edges -= edges;
+	}
+
+	inline void drop_edges(node &holder, std::size_t n) {
+		holder.edges -= static_cast<std::uint32_t>(n);
+		holder.home->stats.edges -= n;
+	}
+
+	inline void sealed_graph::release() {
+		for (std::size_t i = 0; i < nodes.size(); i++) {
+			auto np = nodes[i].lock();
+			if (!np) continue;
+
+			const range &r = ranges[i];
+			if (r.built) {
+				for (std::uint32_t k = r.begin; k < r.end; k++) {
+					r.source->push_back(std::move(targets[k]));
+				}
+			}
+			np->sealed = nullptr;
+		}
+
+		nodes.clear();
+		ranges.clear();
+		targets.clear();
+	}
+
+	/*
+		Attributes an allocation to the clock running or frozen on this
+		thread, if any. Called by the operator new that LIBSIG_ALLOC_STATS
+		installs, or by an application's own replacement.
+	*/
+	inline void note_allocation(std::size_t bytes) {
+		if (clock *c = allocating_clock) {
+			++c->stats.allocations;
+			c->stats.allocated_bytes_total += bytes;
+		}
+	}
+
+	/* the clock that a write or notification from `n` goes to */
+	inline clock & clock_for(const node &n)
+		{ return system.active ? *system.active : *n.home; }
+
+	/* the clock that batches on this thread (e.g. `S.freeze`) apply to */
+	inline clock & current_clock() {
+		if (system.active) return *system.active;
+		return system.context ? *system.context : *system.root_clock;
+	}
+
+	/*
+		Reads that aren't tracked (`sample()`, untracked signals) can't be
+		checked against a memo's cache, so the memoized run making one
+		isn't cached; see `memo`.
+	*/
+	inline void note_untracked_read() {
+		if (system.recording && system.recording->reader == system.observer.get()) {
+			system.recording->cacheable = false;
+		}
+	}
+
+	/*
+		Adds the current observer, skipping it if it was also the last one
+		added. Lists that are read often but rarely written would otherwise
+		keep growing with observers that have since gone away, so once a
+		list of at least LIBSIG_COMPACTTHRESH entries is about to grow it's
+		compacted first; if that doesn't free up half of it, it grows as
+		usual, keeping the cost amortized.
+	*/
+	inline void add_observer(node &holder, observer_list &observers, const std::shared_ptr<node> &o) {
+		if (system.recording && system.recording->reader == o.get() && holder.kind != node_signal) {
+			/* only signal values are recorded */
+			system.recording->cacheable = false;
+		}
+
+		if (o->sealed) {
+#ifdef NDEBUG
+			/* the edge is already part of the sealed graph */
+			if (holder.sealed == o->sealed) return;
+#else
+			bool same = holder.sealed == o->sealed;
+			if (same && holder.sealed->has_edge(holder, observers, o)) return;
+			if (same || sealable(holder)) {
+				/* tracked as usual if the handler returns */
+				LIBSIG_FAIL(error_sealed, std::logic_error, "sealed computation read a node it didn't depend on when sealed");
+			}
+#endif
+		}
+
+		if (!observers.empty()) {
+			const std::weak_ptr<node> &last = observers.back();
+			if (!last.owner_before(o) && !o.owner_before(last)) return;
+		}
+
+		std::size_t cap = observers.capacity();
+#ifdef LIBSIG_HEAP_FREE_AFTER_BUILD
+		if (observers.size() == cap) {
+			compact_observers(observers);
+			drop_edges(holder, cap - observers.size());
+			if (observers.size() == cap) {
+				/* the observer won't be notified by this node */
+				LIBSIG_FAIL(error_capacity, std::length_error, "observer capacity exceeded");
+				return;
+			}
+		}
+#else
+		if (observers.size() == cap && cap >= LIBSIG_COMPACTTHRESH) {
+			compact_observers(observers);
+			drop_edges(holder, cap - observers.size());
+			if (observers.size() > cap / 2) observers.reserve(cap * 2);
+		}
+#endif
+
+		observers.push_back(o);
+		++holder.edges;
+		++holder.home->stats.edges;
+	}
+
+	/*
+		Marks and schedules everything in `observers`, consuming the list;
+		sealed nodes also schedule their range of the sealed graph.
+	*/
+	inline void notify_observers(node &holder, observer_list &observers) {
+		if (holder.sealed) {
+			sealed_graph &g = *holder.sealed;
+			sealed_graph::range *r = &g.ranges[holder.sealed_index];
+			if (!r->built) {
+				/* only expired entries are dropped; the rest still count as edges */
+				std::size_t before = observers.size();
+				r = &g.build(holder.sealed_index, observers);
+				drop_edges(holder, before - observers.size() - (r->end - r->begin));
+			}
+
+			drop_edges(holder, observers.size());
+			const std::weak_ptr<node> *targets = g.targets.data();
+			clock_for(holder).schedule_sealed(targets + r->begin, targets + r->end, observers);
+			return;
+		}
+
+		drop_edges(holder, observers.size());
+		clock_for(holder).consume_and_schedule_all(observers);
+	}
+
+	template <bool RaiseEvent>
+	inline clock::freeze_guard<RaiseEvent>::freeze_guard(clock *_c)
+	: c(_c)
+	, prev(system.active)
+	{
+		++c->frozen;
+		system.active = c;
+		allocating_clock = c;
+		if (RaiseEvent && system.tap) system.tap->on_freeze();
+	}
+
+	template <bool RaiseEvent>
+	inline clock::freeze_guard<RaiseEvent>::freeze_guard(freeze_guard &&other)
+	: c(other.c)
+	, prev(other.prev)
+	{
+		other.c = nullptr;
+	}
+
+	template <bool RaiseEvent>
+	inline clock::freeze_guard<RaiseEvent>::~freeze_guard() noexcept(false) {
+		if (!c) return;
+		system.active = prev;
+		allocating_clock = prev;
+
+		if (RaiseEvent) { /* optimized out */
+			if (system.tap) system.tap->on_thaw();
+			if (--c->frozen == 0) {
+				c->event();
+			}
+		} else {
+			--c->frozen;
+		}
+	}
+
+	struct owner_guard {
+		std::shared_ptr<owner> prev;
+
+		owner_guard(std::shared_ptr<owner> p)
+		: prev(system.current_owner)
+		{
+			system.current_owner = p;
 		}
 
 		~owner_guard() {
@@ -174,6 +1224,23 @@ namespace detail {
 		owner_guard(owner_guard &&) = delete;
 	};
 
+	struct context_guard {
+		std::shared_ptr<clock> prev;
+
+		context_guard(std::shared_ptr<clock> c)
+		: prev(system.context)
+		{
+			system.context = c;
+		}
+
+		~context_guard() {
+			system.context = prev;
+		}
+
+		context_guard(const context_guard &) = delete;
+		context_guard(context_guard &&) = delete;
+	};
+
 	struct observer_guard {
 		std::shared_ptr<node> prev;
 
@@ -191,27 +1258,144 @@ namespace detail {
 		observer_guard(observer_guard &&) = delete;
 	};
 
-	template <typename T, bool Value = false>
+	struct recording_guard {
+		memo_recorder *prev;
+
+		recording_guard(memo_recorder *r)
+		: prev(system.recording)
+		{
+			system.recording = r;
+		}
+
+		~recording_guard() {
+			system.recording = prev;
+		}
+
+		recording_guard(const recording_guard &) = delete;
+		recording_guard(recording_guard &&) = delete;
+	};
+
+	/*
+		An RAII handle for a direct listener (see `signal::subscribe()`);
+		the listener is detached when the handle is destroyed or reset.
+	*/
+	class subscription {
+		std::shared_ptr<void> listener;
+
+	public:
+		subscription() = default;
+
+		subscription(std::shared_ptr<void> _listener)
+		: listener(std::move(_listener))
+		{}
+
+		subscription(subscription &&other) = default;
+		subscription & operator =(subscription &&other) = default;
+
+		subscription(const subscription &) = delete;
+		subscription & operator =(const subscription &) = delete;
+
+		inline void reset()
+			{ listener.reset(); }
+
+		inline explicit operator bool() const
+			{ return listener != nullptr; }
+	};
+
+	inline subscription clock::on_settled(std::function<void()> fn) {
+		auto lp = std::make_shared<settled_listener>();
+		lp->fn = std::move(fn);
+		settled.push_back(lp);
+		return subscription(lp);
+	}
+
+	template <typename E>
+	struct expression;
+
+	template <typename T>
+	struct is_expression : std::false_type {};
+
+	template <typename E>
+	struct is_expression<expression<E>> : std::true_type {};
+
+	/*
+		Compile-time switches for the per-signal hot path work:
+
+		- Tracking: reads within a computation subscribe it to the signal.
+		  Untracked signals read like `sample()`.
+		- Ownership: reads register the signal as a child of the current
+		  owner, keeping it alive for as long as that owner.
+		- Conflicts: a second, differing write within one tick throws.
+		  Without it, the last write wins.
+
+		Equality (`sig` vs `val`) is the signal's `Value` parameter.
+	*/
+	template <bool Tracking = true, bool Ownership = true, bool Conflicts = true>
+	struct signal_policy {
+		static constexpr bool tracking = Tracking;
+		static constexpr bool ownership = Ownership;
+		static constexpr bool conflicts = Conflicts;
+	};
+
+	template <typename T, bool Value = false, typename Policy = signal_policy<>>
 	class signal {
-		template <typename U, bool V>
+		template <typename U, bool V, typename P>
 		friend class signal;
+		friend class registry;
+
+		struct data;
+
+		/* erases its own entry when its subscription is dropped; see `subscribe()` */
+		struct listener {
+			std::function<void(const T &, const T &)> fn;
+			std::weak_ptr<data> owner;
+			typename std::list<std::weak_ptr<listener>>::iterator pos;
+
+			static void drop(listener *l) {
+				if (auto dp = l->owner.lock()) dp->listeners.erase(l->pos);
+				delete l;
+			}
+		};
+
+		struct recorded_read : public memo_read {
+			std::shared_ptr<data> source;
+			T value;
+
+			recorded_read(std::shared_ptr<data> _source, const T &v)
+			: source(std::move(_source))
+			, value(v)
+			{}
+
+			bool unchanged() const override
+				{ return !(source->current_value != value); }
+
+			void depend() override
+				{ source->depend(); }
+		};
 
 		struct data : public node {
 			std::weak_ptr<data> self;
 			T current_value;
 			T scheduled_value;
 			bool value_is_scheduled;
-			std::list<std::weak_ptr<node>> observers;
+			observer_list observers;
+			std::list<std::weak_ptr<listener>> listeners;
 
 			data()
-			: current_value(T())
+			: node(node_signal)
+			, current_value(T())
 			, value_is_scheduled(false)
-			{}
+			{
+				unowned = !Policy::ownership;
+			}
 
 			data(const T &v)
-			: current_value(v)
+			: node(node_signal)
+			, current_value(v)
 			, value_is_scheduled(false)
-			{}
+			{
+				unowned = !Policy::ownership;
+			}
 
 			data(const data &) = delete;
 			data(data &&) = delete;
@@ -229,23 +1413,71 @@ namespace detail {
 			inline void swap() {
 				if (value_is_scheduled) {
 					value_is_scheduled = false;
-					current_value = std::move(scheduled_value);
-					schedule_all_observers();
+
+					if (Value && !Policy::conflicts && !(current_value != scheduled_value)) { /* optimized out */
+						/* a later write within the tick put back the current value */
+						return;
+					}
+
+					if (listeners.empty()) {
+						current_value = std::move(scheduled_value);
+						schedule_all_observers();
+					} else {
+						/* observers are scheduled first, so a throwing listener can't hold them back */
+						T old_value = std::move(current_value);
+						current_value = std::move(scheduled_value);
+						schedule_all_observers();
+						notify_listeners(old_value);
+					}
 				}
 			}
 
-			inline void depend() {
-				if (system.current_owner) {
-					if (auto self_p = self.lock()) {
-						system.current_owner->children.insert(self_p);
+			/* calls every listener, then rethrows the first exception any of them threw */
+			inline void notify_listeners(const T &old_value) {
+#ifndef LIBSIG_NO_EXCEPTIONS
+				std::exception_ptr first;
+#endif
+				for (auto itr = listeners.begin(); itr != listeners.end();) {
+					if (auto lp = itr->lock()) {
+#ifdef LIBSIG_NO_EXCEPTIONS
+						lp->fn(old_value, current_value);
+#else
+						try {
+							lp->fn(old_value, current_value);
+						} catch (...) {
+							if (!first) first = std::current_exception();
+						}
+#endif
+						++itr;
+					} else {
+						itr = listeners.erase(itr);
 					}
 				}
+#ifndef LIBSIG_NO_EXCEPTIONS
+				if (first) std::rethrow_exception(first);
+#endif
+			}
+
+			inline void depend() {
+				if (Policy::ownership && system.current_owner) { /* optimized out */
+					system.current_owner->adopt(*this, self);
+				}
 
-				if (system.observer) {
-					observers.push_back(system.observer);
+				if (!Policy::tracking) { /* optimized out */
+					note_untracked_read();
+				} else if (system.observer) {
+					add_observer(*this, observers, system.observer);
+					if (system.recording && system.recording->reader == system.observer.get()) record();
 				}
 			}
 
+			inline void record() {
+				memo_recorder &r = *system.recording;
+				if (r.last == this) return;
+				r.last = this;
+				r.reads.emplace_back(new recorded_read(self.lock(), current_value));
+			}
+
 			inline T* operator ->()
 				{ depend(); return &current_value; }
 
@@ -255,39 +1487,38 @@ namespace detail {
 			inline void schedule_self() {
 				assert(!value_is_scheduled);
 				value_is_scheduled = true;
-				system.root_clock.schedule_one(self);
+				clock_for(*this).schedule_one(self);
 			}
 
 			inline void schedule_all_observers()
-				{ system.root_clock.consume_and_schedule_all(observers); }
+				{ notify_observers(*this, observers); }
 
 			inline void schedule(const T &v) {
-				if (Value) { /* optimized out */
-					if (value_is_scheduled) {
-							if (v != scheduled_value) {
-								throw std::logic_error("new value conflicts with scheduled value");
-							}
-					} else if (current_value != v) {
-						scheduled_value = v;
-						schedule_self();
-					}
-				} else {
-					if (value_is_scheduled) {
+				if (system.tap) {
+					system.tap->on_write(this, &v);
+				}
+
+				if (value_is_scheduled) {
+					if (Policy::conflicts) { /* optimized out */
 						if (v != scheduled_value) {
-							throw std::logic_error("new value conflicts with scheduled value");
+							/* the first value is kept */
+							LIBSIG_FAIL(error_conflict, std::logic_error, "new value conflicts with scheduled value");
+							return;
 						}
 					} else {
 						scheduled_value = v;
-						schedule_self();
 					}
+				} else if (!Value || current_value != v) { /* optimized out */
+					scheduled_value = v;
+					schedule_self();
 				}
 			}
 
 			inline T& sample()
-				{ return current_value; }
+				{ note_untracked_read(); return current_value; }
 
 			inline const T& sample() const
-				{ return current_value; }
+				{ note_untracked_read(); return current_value; }
 
 #			define LIBSIG_SIG_OP(op) \
 				template <typename U> \
@@ -309,172 +1540,2962 @@ namespace detail {
 #			undef LIBSIG_SIG_OP
 		};
 
-		std::shared_ptr<data> d;
+		std::shared_ptr<data> d;
+
+		signal(std::shared_ptr<data> _d)
+		: d(_d)
+		{}
+
+	public:
+		typedef T signal_type;
+
+		signal()
+		: d(new data())
+		{
+			d->set_self(d);
+		}
+
+		explicit signal(const T &v)
+		: d(new data(v))
+		{
+			d->set_self(d);
+		}
+
+		explicit signal(const signal<T, Value, Policy> &other)
+		: d(other.d)
+		{}
+
+		inline void depend()
+			{ d->depend(); }
+
+		inline operator T&()
+			{ return d->operator T&(); }
+
+		inline T* operator ->()
+			{ return d->operator ->(); }
+
+		template <typename U, bool V, typename P>
+		inline signal<T, Value, Policy> & operator =(signal<U, V, P> &sig)
+			{ d->schedule(sig.operator U&()); return *this; }
+
+		inline signal<T, Value, Policy> & operator =(const T &v)
+			{ d->schedule(v); return *this; }
+
+		inline T& sample()
+			{ return d->sample(); }
+
+		inline const T& sample() const
+			{ return d->sample(); }
+
+		/* the number of observer edges currently held, including stale ones */
+		inline std::size_t observer_count() const
+			{ return d->observers.size(); }
+
+		/* the number of live subscriptions */
+		inline std::size_t listener_count() const
+			{ return d->listeners.size(); }
+
+		/*
+			Calls `fn(old_value, new_value)` whenever a new value is
+			committed, for as long as the returned handle is alive. Unlike
+			a computation, no node is scheduled and nothing is tracked.
+			Listeners run once the signal's observers are scheduled; if
+			one throws, the others still run, and the first exception is
+			handled like one thrown by a computation (see `clock::run`).
+		*/
+		template <typename Fn>
+		inline subscription subscribe(Fn fn) {
+			std::shared_ptr<listener> lp(new listener(), &listener::drop);
+			lp->fn = std::move(fn);
+			lp->owner = d;
+			lp->pos = d->listeners.insert(d->listeners.end(), lp);
+			return subscription(lp);
+		}
+
+#		define LIBSIG_SIG_OP(op) \
+			template <typename U, typename = typename std::enable_if<!is_expression<U>::value>::type> \
+			inline auto operator op(const U &other) \
+				-> decltype(d->operator op(other)) \
+				{ return d->operator op(other); } \
+			template <typename U, bool V, typename P> \
+			inline auto operator op(signal<U, V, P> &other) \
+				-> decltype(d->operator op(other.operator U&())) \
+				{ return d->operator op(other.operator U&()); }
+
+		LIBSIG_SIG_OP(==)
+		LIBSIG_SIG_OP(!=)
+		LIBSIG_SIG_OP(*)
+		LIBSIG_SIG_OP(/)
+		LIBSIG_SIG_OP(+)
+		LIBSIG_SIG_OP(-)
+		LIBSIG_SIG_OP(%)
+		LIBSIG_SIG_OP(^)
+		LIBSIG_SIG_OP(&)
+		LIBSIG_SIG_OP(|)
+
+#		undef LIBSIG_SIG_OP
+
+		friend std::ostream & operator<<(std::ostream &os, signal<T, Value, Policy> &sig) {
+			os << sig.operator T&();
+			return os;
+		}
+	};
+
+	/*
+		Expression templates built from signals with `expr()`, e.g.
+		`S.derive(expr(price) * qty)`. Evaluating an expression reads (and
+		thus depends on) every signal within it.
+	*/
+	template <typename T>
+	struct expr_constant {
+		typedef T value_type;
+		T value;
+
+		inline const T & eval() const
+			{ return value; }
+	};
+
+	template <typename T, bool Value, typename Policy>
+	struct expr_signal {
+		typedef T value_type;
+		mutable signal<T, Value, Policy> sig;
+
+		expr_signal(const signal<T, Value, Policy> &_sig)
+		: sig(_sig)
+		{}
+
+		inline const T & eval() const
+			{ return sig.operator T&(); }
+	};
+
+	template <typename Op, typename L, typename R>
+	struct expr_binary {
+		typedef typename std::decay<decltype(Op::apply(
+			std::declval<const typename L::value_type &>(),
+			std::declval<const typename R::value_type &>()))>::type value_type;
+
+		L l;
+		R r;
+
+		inline value_type eval() const
+			{ return Op::apply(l.eval(), r.eval()); }
+	};
+
+	template <typename E>
+	struct expression {
+		typedef typename E::value_type value_type;
+		E e;
+	};
+
+	template <typename T>
+	struct expr_lift {
+		typedef expr_constant<T> type;
+
+		static inline type make(const T &v)
+			{ return type{v}; }
+	};
+
+	template <typename T, bool Value, typename Policy>
+	struct expr_lift<signal<T, Value, Policy>> {
+		typedef expr_signal<T, Value, Policy> type;
+
+		static inline type make(const signal<T, Value, Policy> &sig)
+			{ return type(sig); }
+	};
+
+	template <typename E>
+	struct expr_lift<expression<E>> {
+		typedef E type;
+
+		static inline type make(const expression<E> &x)
+			{ return x.e; }
+	};
+
+	template <typename T, bool Value, typename Policy>
+	inline expression<expr_signal<T, Value, Policy>> expr(signal<T, Value, Policy> &sig)
+		{ return expression<expr_signal<T, Value, Policy>>{expr_signal<T, Value, Policy>(sig)}; }
+
+#	define LIBSIG_EXPR_OP(op, name) \
+		struct expr_op_##name { \
+			template <typename L, typename R> \
+			static inline auto apply(const L &l, const R &r) \
+				-> decltype(l op r) \
+				{ return l op r; } \
+		}; \
+		template <typename L, typename R> \
+		inline auto operator op(const expression<L> &l, const R &r) \
+			-> expression<expr_binary<expr_op_##name, L, typename expr_lift<R>::type>> \
+			{ return {{l.e, expr_lift<R>::make(r)}}; } \
+		template <typename L, typename R, typename = typename std::enable_if<!is_expression<L>::value>::type> \
+		inline auto operator op(const L &l, const expression<R> &r) \
+			-> expression<expr_binary<expr_op_##name, typename expr_lift<L>::type, R>> \
+			{ return {{expr_lift<L>::make(l), r.e}}; }
+
+	LIBSIG_EXPR_OP(==, eq)
+	LIBSIG_EXPR_OP(!=, ne)
+	LIBSIG_EXPR_OP(*, mul)
+	LIBSIG_EXPR_OP(/, div)
+	LIBSIG_EXPR_OP(+, add)
+	LIBSIG_EXPR_OP(-, sub)
+	LIBSIG_EXPR_OP(%, mod)
+	LIBSIG_EXPR_OP(^, xor)
+	LIBSIG_EXPR_OP(&, and)
+	LIBSIG_EXPR_OP(|, or)
+
+#	undef LIBSIG_EXPR_OP
+
+	/*
+		A read-only signal whose value is an expression over other signals.
+		It is re-evaluated in place whenever one of them changes, without a
+		computation, owner or user closure, and only notifies its own
+		observers if the result actually changed.
+	*/
+	template <typename E>
+	class derived {
+		friend class api;
+
+	public:
+		typedef typename E::value_type signal_type;
+
+	private:
+		typedef signal_type T;
+
+		struct data : public node {
+			std::weak_ptr<data> self;
+			E e;
+			T current_value;
+			observer_list observers;
+
+			data(const E &_e)
+			: node(node_derived)
+			, e(_e)
+			, current_value(T())
+			{}
+
+			data(const data &) = delete;
+			data(data &&) = delete;
+
+			inline void set_self(std::weak_ptr<data> _self) {
+				self = _self;
+
+				this->update = [_self] {
+					if (auto self_p = _self.lock()) {
+						self_p->evaluate();
+					}
+				};
+			}
+
+			inline void evaluate() {
+				if (!stale) return;
+				stale = false;
+				failed = false;
+
+				owner_guard og(nullptr);
+				observer_guard obg(self.lock());
+				T v = e.eval();
+
+				if (v != current_value) {
+					current_value = std::move(v);
+					notify_observers(*this, observers);
+				}
+			}
+
+			inline void depend() {
+				if (system.current_owner) {
+					system.current_owner->adopt(*this, self);
+				}
+
+				if (system.observer) {
+					add_observer(*this, observers, system.observer);
+				}
+			}
+		};
+
+		std::shared_ptr<data> d;
+
+		derived(const E &e)
+		: d(new data(e))
+		{
+			d->set_self(d);
+			d->evaluate();
+		}
+
+	public:
+		derived(const derived &other)
+		: d(other.d)
+		{}
+
+		inline void depend()
+			{ d->depend(); }
+
+		inline operator const T&()
+			{ d->depend(); return d->current_value; }
+
+		inline const T& sample() const
+			{ note_untracked_read(); return d->current_value; }
+
+		friend std::ostream & operator<<(std::ostream &os, derived<E> &der) {
+			os << der.operator const T&();
+			return os;
+		}
+	};
+
+	template <typename E>
+	struct expr_derived {
+		typedef typename E::value_type value_type;
+		mutable derived<E> der;
+
+		inline const value_type & eval() const
+			{ return der.operator const value_type&(); }
+	};
+
+	template <typename E>
+	struct expr_lift<derived<E>> {
+		typedef expr_derived<E> type;
+
+		static inline type make(const derived<E> &der)
+			{ return type{der}; }
+	};
+
+	template <typename E>
+	inline expression<expr_derived<E>> expr(derived<E> &der)
+		{ return expression<expr_derived<E>>{expr_derived<E>{der}}; }
+
+	/*
+		Tracks a key-valued signal on behalf of many observers that each
+		only care whether it equals one particular key. Observers subscribe
+		by key through `is()`, and a change from key A to key B only
+		re-runs the observers of A and B.
+
+		`K` must be ordered (`operator<`) and comparable (`operator!=`).
+	*/
+	template <typename K, bool Value, typename Policy>
+	class selector {
+		friend class api;
+
+		struct data : public node {
+			std::weak_ptr<data> self;
+			signal<K, Value, Policy> source;
+			K current_key;
+			std::map<K, observer_list> subscribers;
+
+			data(const signal<K, Value, Policy> &_source)
+			: node(node_selector)
+			, source(_source)
+			, current_key(K())
+			{}
+
+			data(const data &) = delete;
+			data(data &&) = delete;
+
+			inline void set_self(std::weak_ptr<data> _self) {
+				self = _self;
+
+				this->update = [_self] {
+					if (auto self_p = _self.lock()) {
+						self_p->evaluate();
+					}
+				};
+			}
+
+			inline void evaluate() {
+				if (!stale) return;
+				stale = false;
+
+				owner_guard og(nullptr);
+				observer_guard obg(self.lock());
+				const K &next = source.operator K&();
+
+				if (next != current_key) {
+					notify(current_key);
+					notify(next);
+					current_key = next;
+				}
+			}
+
+			inline void notify(const K &key) {
+				auto itr = subscribers.find(key);
+				if (itr != subscribers.end()) {
+					notify_observers(*this, itr->second);
+#ifndef LIBSIG_HEAP_FREE_AFTER_BUILD
+					/* with fixed capacities, emptied lists are kept so re-subscribing doesn't allocate */
+					subscribers.erase(itr);
+#endif
+				}
+			}
+
+			inline bool is(const K &key) {
+				if (system.current_owner) {
+					system.current_owner->adopt(*this, self);
+				}
+
+				if (system.observer) {
+					add_observer(*this, subscribers[key], system.observer);
+				}
+
+				return !(key != current_key);
+			}
+		};
+
+		std::shared_ptr<data> d;
+
+		selector(const signal<K, Value, Policy> &source)
+		: d(new data(source))
+		{
+			d->set_self(d);
+			d->evaluate();
+		}
+
+	public:
+		selector(const selector &other)
+		: d(other.d)
+		{}
+
+		/* depends only on whether the source equals `key` */
+		inline bool is(const K &key)
+			{ return d->is(key); }
+
+		inline const K & sample() const
+			{ note_untracked_read(); return d->current_key; }
+	};
+
+	/*
+		A chain of member pointers leading from `T` to one of its (possibly
+		nested) fields, e.g. `path<Config, Net Config::*, int Net::*>`.
+	*/
+	template <typename T, typename... Members>
+	struct path;
+
+	template <typename T>
+	struct path<T> {
+		typedef T type;
+
+		inline T & get(T &t) const
+			{ return t; }
+
+		inline const T & get(const T &t) const
+			{ return t; }
+	};
+
+	template <typename T, typename M, typename... Rest>
+	struct path<T, M T::*, Rest...> {
+		typedef typename path<M, Rest...>::type type;
+
+		M T::*member;
+		path<M, Rest...> rest;
+
+		inline type & get(T &t) const
+			{ return rest.get(t.*member); }
+
+		inline const type & get(const T &t) const
+			{ return rest.get(t.*member); }
+	};
+
+	template <typename T>
+	inline path<T> make_path()
+		{ return path<T>(); }
+
+	template <typename T, typename M, typename... Rest>
+	inline path<T, M T::*, Rest...> make_path(M T::*member, Rest... rest) {
+		path<T, M T::*, Rest...> p;
+		p.member = member;
+		p.rest = make_path<M>(rest...);
+		return p;
+	}
+
+	/*
+		A struct-valued signal whose fields can be tracked individually.
+		`at(&T::a, &A::b, ...)` returns a lens onto a (nested) field; reading
+		a lens only depends on that field, and its observers only re-run if
+		the field compares unequal after a write.
+
+		Writes through lenses, `update()` and assignment are all staged onto
+		a copy of the value and applied together at the next tick, so
+		several fields can be changed in one batch. Reading the store
+		itself depends on the whole value and re-runs on every write.
+	*/
+	template <typename T>
+	class store {
+		typedef std::pair<std::size_t, std::size_t> field_key;
+
+		struct field {
+			std::function<bool(const T &, const T &)> changed;
+			observer_list observers;
+		};
+
+		struct data : public node {
+			std::weak_ptr<data> self;
+			T current_value;
+			T staged_value;
+			bool value_is_scheduled;
+			observer_list observers;
+			std::map<field_key, field> fields;
+
+			data(const T &v)
+			: node(node_store)
+			, current_value(v)
+			, value_is_scheduled(false)
+			{}
+
+			data(const data &) = delete;
+			data(data &&) = delete;
+
+			inline void set_self(std::weak_ptr<data> _self) {
+				self = _self;
+
+				this->update = [_self] {
+					if (auto self_p = _self.lock()) {
+						self_p->swap();
+					}
+				};
+			}
+
+			inline void swap() {
+				if (!value_is_scheduled) return;
+				value_is_scheduled = false;
+
+				for (auto &f : fields) {
+					if (f.second.observers.size() && f.second.changed(current_value, staged_value)) {
+						notify_observers(*this, f.second.observers);
+					}
+				}
+
+				current_value = std::move(staged_value);
+				notify_observers(*this, observers);
+			}
+
+			template <typename Fn>
+			inline void write(Fn fn) {
+				if (value_is_scheduled) {
+					fn(staged_value);
+				} else {
+					staged_value = current_value;
+					fn(staged_value);
+					value_is_scheduled = true;
+					clock_for(*this).schedule_one(self);
+				}
+			}
+
+			inline void own() {
+				if (system.current_owner) {
+					system.current_owner->adopt(*this, self);
+				}
+			}
+
+			inline void depend() {
+				own();
+
+				if (system.observer) {
+					add_observer(*this, observers, system.observer);
+				}
+			}
+
+			template <typename P>
+			inline void depend(const field_key &key, const P &p) {
+				own();
+
+				if (system.observer) {
+					auto itr = fields.find(key);
+					if (itr == fields.end()) {
+						itr = fields.insert(std::make_pair(key, field())).first;
+						itr->second.changed = [p](const T &a, const T &b) {
+							return p.get(a) != p.get(b);
+						};
+					}
+
+					add_observer(*this, itr->second.observers, system.observer);
+				}
+			}
+		};
+
+		std::shared_ptr<data> d;
+
+	public:
+		typedef T signal_type;
+
+		template <typename P>
+		class lens {
+			friend class store;
+
+			std::shared_ptr<data> d;
+			P p;
+			field_key key;
+
+			lens(std::shared_ptr<data> _d, const P &_p)
+			: d(_d)
+			, p(_p)
+			{
+				const T &root = d->current_value;
+				const char *base = reinterpret_cast<const char *>(&root);
+				const char *at = reinterpret_cast<const char *>(&p.get(root));
+				key = field_key(static_cast<std::size_t>(at - base), sizeof(typename P::type));
+			}
+
+		public:
+			typedef typename P::type signal_type;
+
+			inline void depend()
+				{ d->depend(key, p); }
+
+			inline operator const signal_type&()
+				{ d->depend(key, p); return p.get(d->current_value); }
+
+			inline const signal_type & sample() const
+				{ note_untracked_read(); return p.get(d->current_value); }
+
+			inline lens & operator =(const signal_type &v) {
+				const P &path = p;
+				d->write([&path, &v](T &t) { path.get(t) = v; });
+				return *this;
+			}
+		};
+
+		explicit store(const T &v = T())
+		: d(new data(v))
+		{
+			d->set_self(d);
+		}
+
+		store(const store &other)
+		: d(other.d)
+		{}
+
+		template <typename... Members>
+		inline auto at(Members... members) -> lens<decltype(make_path<T>(members...))>
+			{ return lens<decltype(make_path<T>(members...))>(d, make_path<T>(members...)); }
+
+		inline void depend()
+			{ d->depend(); }
+
+		inline operator const T&()
+			{ d->depend(); return d->current_value; }
+
+		inline const T* operator ->()
+			{ d->depend(); return &d->current_value; }
+
+		inline const T & sample() const
+			{ note_untracked_read(); return d->current_value; }
+
+		/* calls `fn(T &)` to modify several fields in one batch */
+		template <typename Fn>
+		inline void update(Fn fn)
+			{ d->write(fn); }
+
+		inline store & operator =(const T &v) {
+			d->write([&v](T &t) { t = v; });
+			return *this;
+		}
+	};
+
+	/*
+		A fixed-size, contiguous array of values acting as a single signal.
+		Writes (single elements or bulk) are staged and applied at the next
+		tick, at which point the staged values are compared against the
+		current ones 64 elements at a time to build a dirty bitmap.
+		Observers of the whole buffer re-run if anything changed;
+		observers of a single element (read through `at()`) only re-run if
+		that element changed.
+
+		Multiple writes to the same element within a tick don't conflict;
+		the last one wins.
+	*/
+	template <typename T>
+	class signal_buffer {
+		struct data : public node {
+			std::weak_ptr<data> self;
+			std::vector<T> current;
+			std::vector<T> staged;
+			std::vector<std::uint64_t> dirty;
+			std::size_t dirty_count;
+			std::size_t staged_lo;
+			std::size_t staged_hi;
+			bool value_is_scheduled;
+			observer_list observers;
+			std::map<std::size_t, observer_list> element_observers;
+
+			data(std::size_t n, const T &v)
+			: node(node_buffer)
+			, current(n, v)
+			, staged(n, v)
+			, dirty((n + 63) / 64, 0)
+			, dirty_count(0)
+			, staged_lo(n)
+			, staged_hi(0)
+			, value_is_scheduled(false)
+			{}
+
+			data(const data &) = delete;
+			data(data &&) = delete;
+
+			inline void set_self(std::weak_ptr<data> _self) {
+				self = _self;
+
+				this->update = [_self] {
+					if (auto self_p = _self.lock()) {
+						self_p->swap();
+					}
+				};
+			}
+
+			inline T * stage(std::size_t lo, std::size_t hi) {
+				if (hi > current.size() || lo > hi) {
+					/* the write is dropped */
+					LIBSIG_FAIL(error_out_of_range, std::out_of_range, "signal buffer write out of range");
+					return nullptr;
+				}
+
+				if (lo < staged_lo) staged_lo = lo;
+				if (hi > staged_hi) staged_hi = hi;
+
+				return staged.data();
+			}
+
+			/* must follow writes to the staged values */
+			inline void commit() {
+				if (!value_is_scheduled) {
+					value_is_scheduled = true;
+					clock_for(*this).schedule_one(self);
+				}
+			}
+
+			static inline std::uint64_t compare_block(const T *a, const T *b, std::size_t n, std::true_type) {
+				if (std::memcmp(a, b, n * sizeof(T)) == 0) return 0;
+				return compare_block(a, b, n, std::false_type());
+			}
+
+			static inline std::uint64_t compare_block(const T *a, const T *b, std::size_t n, std::false_type) {
+				std::uint64_t mask = 0;
+				for (std::size_t i = 0; i < n; i++) {
+					mask |= static_cast<std::uint64_t>(a[i] != b[i]) << i;
+				}
+				return mask;
+			}
+
+			inline void swap() {
+				if (!value_is_scheduled) return;
+				value_is_scheduled = false;
+
+				std::fill(dirty.begin(), dirty.end(), 0);
+				dirty_count = 0;
+
+				std::size_t size = current.size();
+				for (std::size_t w = staged_lo / 64; w * 64 < staged_hi; w++) {
+					std::size_t base = w * 64;
+					std::size_t n = size - base < 64 ? size - base : 64;
+
+					std::uint64_t mask = compare_block(
+						&current[base], &staged[base], n,
+						typename std::is_trivially_copyable<T>::type());
+
+					dirty[w] = mask;
+					for (; mask; mask &= mask - 1) {
+						std::size_t i = base + static_cast<std::size_t>(ctz64(mask));
+						current[i] = staged[i];
+						++dirty_count;
+					}
+				}
+
+				staged_lo = size;
+				staged_hi = 0;
+
+				if (!dirty_count) return;
+
+				if (element_observers.size() < dirty_count) {
+					for (auto itr = element_observers.begin(); itr != element_observers.end();) {
+						if (is_dirty(itr->first)) {
+							notify_observers(*this, itr->second);
+#ifdef LIBSIG_HEAP_FREE_AFTER_BUILD
+							/* emptied lists are kept, so re-reading an element doesn't allocate */
+							++itr;
+#else
+							itr = element_observers.erase(itr);
+#endif
+						} else {
+							++itr;
+						}
+					}
+				} else {
+					for (std::size_t w = 0; w < dirty.size(); w++) {
+						for (std::uint64_t mask = dirty[w]; mask; mask &= mask - 1) {
+							auto itr = element_observers.find(w * 64 + static_cast<std::size_t>(ctz64(mask)));
+							if (itr != element_observers.end()) {
+								notify_observers(*this, itr->second);
+#ifndef LIBSIG_HEAP_FREE_AFTER_BUILD
+								element_observers.erase(itr);
+#endif
+							}
+						}
+					}
+				}
+
+				notify_observers(*this, observers);
+			}
+
+			inline bool is_dirty(std::size_t i) const
+				{ return (dirty[i / 64] >> (i % 64)) & 1; }
+
+			inline void own() {
+				if (system.current_owner) {
+					system.current_owner->adopt(*this, self);
+				}
+			}
+
+			inline void depend() {
+				own();
+
+				if (system.observer) {
+					add_observer(*this, observers, system.observer);
+				}
+			}
+
+			inline void depend(std::size_t i) {
+				own();
+
+				if (system.observer) {
+					add_observer(*this, element_observers[i], system.observer);
+				}
+			}
+		};
+
+		std::shared_ptr<data> d;
+
+	public:
+		typedef T signal_type;
+
+		explicit signal_buffer(std::size_t n, const T &v = T())
+		: d(new data(n, v))
+		{
+			d->set_self(d);
+		}
+
+		signal_buffer(const signal_buffer &other)
+		: d(other.d)
+		{}
+
+		inline std::size_t size() const
+			{ return d->current.size(); }
+
+		/* depends on the whole buffer */
+		inline void depend()
+			{ d->depend(); }
+
+		inline const T * values()
+			{ d->depend(); return d->current.data(); }
+
+		/* depends only on element `i` */
+		inline const T & at(std::size_t i) {
+			if (i >= size()) {
+				/* reads a value-initialized T instead, untracked */
+				LIBSIG_FAIL(error_out_of_range, std::out_of_range, "signal buffer read out of range");
+				static const T none = T();
+				return none;
+			}
+
+			d->depend(i);
+			return d->current[i];
+		}
+
+		inline const T & operator [](std::size_t i)
+			{ return at(i); }
+
+		inline const std::vector<T> & sample() const
+			{ note_untracked_read(); return d->current; }
+
+		inline const T & sample(std::size_t i) const
+			{ note_untracked_read(); return d->current[i]; }
+
+		inline void set(std::size_t i, const T &v) {
+			if (T *staged = d->stage(i, i + 1)) {
+				staged[i] = v;
+				d->commit();
+			}
+		}
+
+		inline void assign(const T *values, std::size_t count, std::size_t offset = 0) {
+			if (T *staged = d->stage(offset, offset + count)) {
+				std::copy(values, values + count, staged + offset);
+				d->commit();
+			}
+		}
+
+		inline void assign(const std::vector<T> &values)
+			{ assign(values.data(), values.size()); }
+
+		/*
+			Calls `fn(T *values, std::size_t size)` with the staged values
+			for in-place bulk modification.
+		*/
+		template <typename Fn>
+		inline void modify(Fn fn) {
+			fn(d->stage(0, size()), size());
+			d->commit();
+		}
+
+		/* elements changed by the most recent update */
+		inline bool changed(std::size_t i) const
+			{ return d->is_dirty(i); }
+
+		inline std::size_t changed_count() const
+			{ return d->dirty_count; }
+
+		/* dirty bitmap of the most recent update, 64 elements per word */
+		inline const std::vector<std::uint64_t> & changed_bits() const
+			{ return d->dirty; }
+	};
+
+	template <typename T, std::size_t N>
+	class signal_array : public signal_buffer<T> {
+	public:
+		explicit signal_array(const T &v = T())
+		: signal_buffer<T>(N, v)
+		{}
+
+		signal_array(const signal_array &other)
+		: signal_buffer<T>(other)
+		{}
+
+		static constexpr std::size_t size()
+			{ return N; }
+	};
+
+	class computation {
+		friend class api;
+		friend class signal_root;
+
+		struct data : public node, public owner {
+			std::weak_ptr<data> self;
+			std::function<void()> fn;
+			observer_list observers;
+			/* takes precedence over the clock's */
+			error_boundary on_error;
+
+			data(std::function<void()> _fn, node_kind k)
+			: node(k)
+			, fn(std::move(_fn))
+			{}
+
+			inline void depend() {
+				if (system.observer) {
+					add_observer(*this, observers, system.observer);
+				}
+			}
+
+			inline void schedule_all_observers()
+				{ notify_observers(*this, observers); }
+
+			inline void set_self(std::weak_ptr<data> _self) {
+				self = _self;
+
+				this->update = [_self] {
+					if (auto self_p = _self.lock()) {
+						self_p->recompute();
+					}
+				};
+			}
+
+			void recompute() {
+				if (auto self_p = self.lock()) {
+					if (stale && sealed) {
+						/* the shape is fixed: nothing is released, adopted or tracked */
+						stale = false;
+						owner_guard og(nullptr);
+						context_guard cg(home);
+						observer_guard obg(self_p);
+						if (invoke()) schedule_all_observers();
+					} else if (stale) {
+						stale = false;
+						release_children();
+						owner_guard og(self_p);
+						context_guard cg(home);
+						observer_guard obg(self_p);
+						if (invoke()) schedule_all_observers();
+					}
+				}
+			}
+
+			/*
+				Runs `fn`, handing anything it throws to this computation's
+				boundary, if set; returns false if it threw. Either way, a
+				failed run doesn't notify observers, as with the clock's
+				boundary (see `clock::run`).
+			*/
+			inline bool invoke() {
+				failed = false;
+#ifndef LIBSIG_NO_EXCEPTIONS
+				if (on_error) {
+					try {
+						fn();
+					} catch (...) {
+						failed = true;
+						++home->stats.errors;
+						on_error(std::current_exception());
+						return false;
+					}
+					return true;
+				}
+#endif
+				fn();
+				return true;
+			}
+
+			inline void schedule_self()
+				{ clock_for(*this).schedule_one(self); }
+		};
+
+		/* `n` must be of kind node_computation or node_effect */
+		static inline owner & owner_of(node &n)
+			{ return static_cast<data &>(n); }
+
+		std::shared_ptr<data> d;
+
+		computation(std::function<void()> fn, node_kind k = node_computation, error_boundary on_error = nullptr)
+		: d(new data(std::move(fn), k))
+		{
+			d->set_self(d);
+			d->on_error = std::move(on_error);
+
+			if (system.current_owner) {
+				system.current_owner->adopt(d);
+			} else if (system.observer && system.observer->sealed) {
+				/* the computation never runs */
+				LIBSIG_FAIL(error_sealed, std::logic_error, "computations can't be created within a sealed root");
+				return;
+			} else {
+				/* the computation never runs */
+				LIBSIG_FAIL(error_no_owner, std::logic_error, "computations must be created from within a sig_root context");
+				return;
+			}
+
+			d->schedule_self();
+		}
+
+	public:
+		computation(const computation &other)
+		: d(other.d)
+		{}
+
+		/* whether the last run threw */
+		inline bool failed() const
+			{ return d->failed; }
+	};
+
+	/*
+		Maps a list signal to one child scope per distinct key. Each time
+		the list changes, scopes whose keys are still present are kept (and
+		their item signal updated), scopes for new keys are created by
+		calling `child_fn` once, and scopes for keys that went away are
+		disposed along with everything created within them.
+
+		`child_fn` runs untracked with the new scope as its owner; it
+		receives the item as a val<T>, so it should use computations to
+		react to later changes of that item.
+	*/
+	template <typename T, typename K>
+	class keyed_map {
+		friend class api;
+
+		struct entry {
+			std::shared_ptr<owner> scope;
+			signal<T, true> item;
+			age_t seen;
+
+			entry(const T &v)
+			: scope(std::make_shared<owner>())
+			, item(v)
+			, seen(0)
+			{}
+		};
+
+		typedef std::map<K, std::unique_ptr<entry>> entry_map;
+
+		struct data : public node {
+			std::weak_ptr<data> self;
+			std::function<const std::vector<T> &()> source;
+			std::function<K(const T &)> key_fn;
+			std::function<void(signal<T, true> &)> child_fn;
+			entry_map entries;
+			age_t runs;
+
+			data(std::function<const std::vector<T> &()> _source,
+				std::function<K(const T &)> _key_fn,
+				std::function<void(signal<T, true> &)> _child_fn)
+			: node(node_keyed_map)
+			, source(std::move(_source))
+			, key_fn(std::move(_key_fn))
+			, child_fn(std::move(_child_fn))
+			, runs(0)
+			{}
+
+			data(const data &) = delete;
+			data(data &&) = delete;
+
+			inline void set_self(std::weak_ptr<data> _self) {
+				self = _self;
+
+				this->update = [_self] {
+					if (auto self_p = _self.lock()) {
+						self_p->reconcile();
+					}
+				};
+			}
+
+			/* always runs within a clock event, so `items` can't be swapped out from under us */
+			void reconcile() {
+				if (!stale) return;
+				stale = false;
+
+				owner_guard og(nullptr);
+				const std::vector<T> *items;
+				{
+					observer_guard obg(self.lock());
+					items = &source();
+				}
+
+				age_t run = ++runs;
+				for (const T &v : *items) {
+					K key = key_fn(v);
+					auto itr = entries.find(key);
+
+					if (itr == entries.end()) {
+						std::unique_ptr<entry> e(new entry(v));
+						{
+							owner_guard sog(e->scope);
+							context_guard cg(home);
+							child_fn(e->item);
+						}
+						itr = entries.insert(std::make_pair(std::move(key), std::move(e))).first;
+					} else if (itr->second->seen == run) {
+						/* the later item is skipped */
+						LIBSIG_FAIL(error_duplicate_key, std::logic_error, "duplicate key in keyed map");
+						continue;
+					} else {
+						itr->second->item = v;
+					}
+
+					itr->second->seen = run;
+				}
+
+				/* whatever wasn't seen went away */
+				for (auto itr = entries.begin(); itr != entries.end();) {
+					if (itr->second->seen != run) {
+						itr = entries.erase(itr);
+					} else {
+						++itr;
+					}
+				}
+			}
+		};
+
+		std::shared_ptr<data> d;
+
+		template <bool Value, typename Policy>
+		keyed_map(signal<std::vector<T>, Value, Policy> &list,
+			std::function<K(const T &)> key_fn,
+			std::function<void(signal<T, true> &)> child_fn)
+		{
+			signal<std::vector<T>, Value, Policy> source(list);
+			d.reset(new data(
+				[source]() mutable -> const std::vector<T> & {
+					return source.operator std::vector<T>&();
+				},
+				std::move(key_fn), std::move(child_fn)));
+			d->set_self(d);
+
+			if (system.current_owner) {
+				system.current_owner->adopt(d);
+			} else if (system.observer && system.observer->sealed) {
+				/* the map never runs */
+				LIBSIG_FAIL(error_sealed, std::logic_error, "keyed maps can't be created within a sealed root");
+				return;
+			} else {
+				/* the map never runs */
+				LIBSIG_FAIL(error_no_owner, std::logic_error, "keyed maps must be created from within a sig_root context");
+				return;
+			}
+
+			clock_for(*d).schedule_one(d);
+		}
+
+	public:
+		keyed_map(const keyed_map &other)
+		: d(other.d)
+		{}
+
+		/* the number of live child scopes */
+		inline std::size_t size() const
+			{ return d->entries.size(); }
+	};
+
+	typedef std::chrono::steady_clock::time_point time_point;
+	typedef std::chrono::steady_clock::duration duration;
+
+	/* where timers get the current time from */
+	struct time_source {
+		virtual ~time_source() = default;
+		virtual time_point now() = 0;
+	};
+
+	struct steady_time : public time_source {
+		time_point now() override
+			{ return std::chrono::steady_clock::now(); }
+	};
+
+	/* a time source that only moves when told to, for tests and simulations */
+	class manual_time : public time_source {
+		time_point current;
+
+	public:
+		manual_time()
+		: current()
+		{}
+
+		time_point now() override
+			{ return current; }
+
+		inline void advance(duration d)
+			{ current += d; }
+	};
+
+	/*
+		Timed callbacks for the time-based operators. libsig has no event
+		loop of its own, so the application calls `poll()` whenever it
+		wakes up (e.g. at `next_deadline()`); due callbacks then run
+		within a single freeze of the current clock.
+
+		The queue must outlive the operators that use it.
+	*/
+	class timer_queue {
+		time_source *source;
+		steady_time steady;
+		std::multimap<time_point, std::function<void()>> timers;
+
+	public:
+		timer_queue()
+		: source(&steady)
+		{}
+
+		explicit timer_queue(time_source &_source)
+		: source(&_source)
+		{}
+
+		timer_queue(const timer_queue &) = delete;
+		timer_queue(timer_queue &&) = delete;
+
+		inline time_point now()
+			{ return source->now(); }
+
+		inline void at(time_point when, std::function<void()> fn)
+			{ timers.insert(std::make_pair(when, std::move(fn))); }
+
+		/* time_point::max() if nothing is pending */
+		inline time_point next_deadline() const {
+			return timers.empty()
+				? time_point::max()
+				: timers.begin()->first;
+		}
+
+		inline std::size_t size() const
+			{ return timers.size(); }
+
+		/* runs every callback that is due; returns how many ran */
+		std::size_t poll() {
+			time_point t = now();
+			std::size_t fired = 0;
+
+			auto fg = current_clock().freeze<true>();
+			while (!timers.empty() && timers.begin()->first <= t) {
+				std::function<void()> fn = std::move(timers.begin()->second);
+				timers.erase(timers.begin());
+				fn();
+				++fired;
+			}
+
+			return fired;
+		}
+	};
+
+	enum timed_mode {
+		/* emits right away, then at most once per interval (with the latest value) */
+		timed_throttle,
+		/* emits once the source has been quiet for an interval */
+		timed_debounce,
+		/* emits the latest value every interval, if it changed */
+		timed_sample
+	};
+
+	/*
+		A read-only signal that follows another one at a limited rate.
+		The source's commits are picked up through a subscription, so they
+		don't re-run anything but this node's bookkeeping; only emissions
+		(at most one per interval) propagate to observers.
+	*/
+	template <typename T>
+	class timed {
+		friend class api;
+
+		struct data : public node {
+			std::weak_ptr<data> self;
+			timed_mode mode;
+			duration interval;
+			timer_queue *timers;
+			subscription source_sub;
+			T current_value;
+			T staged_value;
+			T pending_value;
+			bool value_is_scheduled;
+			bool has_pending;
+			bool armed;
+			/* throttle: earliest next emission; debounce: when the source went quiet */
+			time_point deadline;
+			observer_list observers;
+
+			data(timed_mode _mode, duration _interval, timer_queue &_timers, const T &v)
+			: node(node_timed)
+			, mode(_mode)
+			, interval(_interval)
+			, timers(&_timers)
+			, current_value(v)
+			, staged_value(v)
+			, pending_value(v)
+			, value_is_scheduled(false)
+			, has_pending(false)
+			, armed(false)
+			, deadline()
+			{}
+
+			data(const data &) = delete;
+			data(data &&) = delete;
+
+			inline void set_self(std::weak_ptr<data> _self) {
+				self = _self;
+
+				this->update = [_self] {
+					if (auto self_p = _self.lock()) {
+						self_p->swap();
+					}
+				};
+			}
+
+			inline void swap() {
+				if (!value_is_scheduled) return;
+				value_is_scheduled = false;
+				current_value = staged_value;
+				notify_observers(*this, observers);
+			}
+
+			inline void emit(const T &v) {
+				staged_value = v;
+				if (!value_is_scheduled) {
+					value_is_scheduled = true;
+					clock_for(*this).schedule_one(self);
+				}
+			}
+
+			inline void arm(time_point when) {
+				armed = true;
+				std::weak_ptr<data> weak = self;
+				timers->at(when, [weak] {
+					if (auto self_p = weak.lock()) {
+						self_p->fire();
+					}
+				});
+			}
+
+			void on_commit(const T &v) {
+				time_point t = timers->now();
+
+				switch (mode) {
+				case timed_throttle:
+					if (!armed && t >= deadline) {
+						emit(v);
+						deadline = t + interval;
+					} else {
+						pending_value = v;
+						has_pending = true;
+						if (!armed) arm(deadline);
+					}
+					break;
+				case timed_debounce:
+					pending_value = v;
+					has_pending = true;
+					deadline = t + interval;
+					if (!armed) arm(deadline);
+					break;
+				case timed_sample:
+					pending_value = v;
+					has_pending = true;
+					break;
+				}
+			}
+
+			void fire() {
+				armed = false;
+				time_point t = timers->now();
+
+				switch (mode) {
+				case timed_throttle:
+					if (has_pending) {
+						emit(pending_value);
+						has_pending = false;
+						deadline = t + interval;
+					}
+					break;
+				case timed_debounce:
+					if (t < deadline) {
+						arm(deadline);
+					} else if (has_pending) {
+						emit(pending_value);
+						has_pending = false;
+					}
+					break;
+				case timed_sample:
+					if (has_pending) {
+						emit(pending_value);
+						has_pending = false;
+					}
+					arm(t + interval);
+					break;
+				}
+			}
+
+			inline void depend() {
+				if (system.current_owner) {
+					system.current_owner->adopt(*this, self);
+				}
+
+				if (system.observer) {
+					add_observer(*this, observers, system.observer);
+				}
+			}
+		};
+
+		std::shared_ptr<data> d;
+
+		template <bool Value, typename Policy>
+		timed(signal<T, Value, Policy> &source, timed_mode mode, duration interval, timer_queue &timers)
+		: d(new data(mode, interval, timers, source.sample()))
+		{
+			if (interval <= duration::zero()) {
+				/* the shortest interval is used instead */
+				LIBSIG_FAIL(error_invalid_argument, std::invalid_argument, "timed signal interval must be positive");
+				d->interval = duration(1);
+			}
+
+			d->set_self(d);
+
+			std::weak_ptr<data> weak = d;
+			d->source_sub = source.subscribe([weak](const T &, const T &new_value) {
+				if (auto self_p = weak.lock()) {
+					self_p->on_commit(new_value);
+				}
+			});
+
+			if (mode == timed_sample) {
+				d->arm(timers.now() + interval);
+			}
+		}
+
+	public:
+		typedef T signal_type;
+
+		timed(const timed &other)
+		: d(other.d)
+		{}
+
+		inline void depend()
+			{ d->depend(); }
+
+		inline operator const T&()
+			{ d->depend(); return d->current_value; }
+
+		inline const T& sample() const
+			{ note_untracked_read(); return d->current_value; }
+
+		friend std::ostream & operator<<(std::ostream &os, timed<T> &t) {
+			os << t.operator const T&();
+			return os;
+		}
+	};
+
+	/*
+		Aggregation operations for `aggregate`. Each is seeded with every
+		source's value, then told about one source's change at a time.
+	*/
+
+	/*
+		Combines the sources pairwise in a segment tree of 2n entries
+		whose leaves are the sources; a change walks from its leaf to the
+		root, in O(log n). `Combine::apply(a, b)` combines two entries.
+		With no sources, the value is T().
+	*/
+	template <typename T, typename Combine>
+	struct aggregate_tree {
+		typedef T value_type;
+		std::vector<T> tree;
+		std::size_t leaves;
+		T none;
+
+		aggregate_tree()
+		: leaves(0)
+		, none()
+		{}
+
+		inline void init(const std::vector<T> &values) {
+			leaves = values.size();
+			if (!leaves) return;
+
+			tree.resize(leaves * 2);
+			std::copy(values.begin(), values.end(), tree.begin() + leaves);
+			for (std::size_t i = leaves - 1; i > 0; i--) {
+				tree[i] = Combine::apply(tree[i * 2], tree[i * 2 + 1]);
+			}
+		}
+
+		inline void change(std::size_t i, const T &, const T &new_value) {
+			i += leaves;
+			tree[i] = new_value;
+			for (i /= 2; i > 0; i /= 2) {
+				tree[i] = Combine::apply(tree[i * 2], tree[i * 2 + 1]);
+			}
+		}
+
+		/* for a single source, tree[1] is its leaf */
+		inline const T & value() const
+			{ return leaves ? tree[1] : none; }
+	};
+
+	struct combine_sum {
+		template <typename T>
+		static inline T apply(const T &a, const T &b)
+			{ return a + b; }
+	};
+
+	/* the least by `Compare` */
+	template <typename Compare>
+	struct combine_extreme {
+		template <typename T>
+		static inline const T & apply(const T &a, const T &b)
+			{ return Compare()(b, a) ? b : a; }
+	};
+
+	/*
+		Running sum; each change is applied as a delta, in O(1). Floating
+		point deltas drift away from the sum of the current values over
+		time, so floating point sums are kept in a tree instead, in
+		O(log n), and only ever depend on the current values.
+	*/
+	template <typename T, bool Exact = !std::is_floating_point<T>::value>
+	struct aggregate_sum {
+		typedef T value_type;
+		T total;
+
+		aggregate_sum()
+		: total()
+		{}
+
+		inline void init(const std::vector<T> &values) {
+			for (const auto &v : values) total += v;
+		}
+
+		inline void change(std::size_t, const T &old_value, const T &new_value)
+			{ total += new_value - old_value; }
+
+		inline const T & value() const
+			{ return total; }
+	};
+
+	template <typename T>
+	struct aggregate_sum<T, false> : public aggregate_tree<T, combine_sum> {};
+
+	/* the number of sources whose value satisfies a predicate, in O(1) */
+	template <typename T>
+	struct aggregate_count {
+		typedef std::size_t value_type;
+		std::function<bool(const T &)> pred;
+		std::size_t matching;
+
+		aggregate_count(std::function<bool(const T &)> _pred)
+		: pred(std::move(_pred))
+		, matching(0)
+		{}
+
+		inline void init(const std::vector<T> &values) {
+			for (const auto &v : values) matching += pred(v) ? 1 : 0;
+		}
+
+		inline void change(std::size_t, const T &old_value, const T &new_value) {
+			matching -= pred(old_value) ? 1 : 0;
+			matching += pred(new_value) ? 1 : 0;
+		}
+
+		inline const std::size_t & value() const
+			{ return matching; }
+	};
+
+	/* the extreme (least by `Compare`) value, in O(log n) */
+	template <typename T, typename Compare>
+	struct aggregate_extreme : public aggregate_tree<T, combine_extreme<Compare>> {};
+
+	/*
+		A read-only signal aggregating many sources. Source commits are
+		picked up through subscriptions and applied to `Op` one at a time,
+		so a single changed source costs O(1) or O(log n) rather than a
+		rescan; however many sources change within a tick, the result is
+		propagated once (and only if it changed).
+	*/
+	template <typename Op>
+	class aggregate {
+		friend class api;
+
+	public:
+		typedef typename Op::value_type value_type;
+
+	private:
+		struct data : public node {
+			std::weak_ptr<data> self;
+			Op op;
+			std::vector<subscription> sources;
+			value_type current_value;
+			bool value_is_scheduled;
+			observer_list observers;
+
+			data(Op _op)
+			: node(node_aggregate)
+			, op(std::move(_op))
+			, current_value()
+			, value_is_scheduled(false)
+			{}
+
+			data(const data &) = delete;
+			data(data &&) = delete;
+
+			inline void set_self(std::weak_ptr<data> _self) {
+				self = _self;
+
+				this->update = [_self] {
+					if (auto self_p = _self.lock()) {
+						self_p->swap();
+					}
+				};
+			}
+
+			inline void swap() {
+				if (!value_is_scheduled) return;
+				value_is_scheduled = false;
+				if (op.value() != current_value) {
+					current_value = op.value();
+					notify_observers(*this, observers);
+				}
+			}
+
+			template <typename T>
+			inline void on_commit(std::size_t i, const T &old_value, const T &new_value) {
+				op.change(i, old_value, new_value);
+				if (!value_is_scheduled) {
+					value_is_scheduled = true;
+					clock_for(*this).schedule_one(self);
+				}
+			}
+
+			inline void depend() {
+				if (system.current_owner) {
+					system.current_owner->adopt(*this, self);
+				}
+
+				if (system.observer) {
+					add_observer(*this, observers, system.observer);
+				}
+			}
+		};
+
+		std::shared_ptr<data> d;
+
+		template <typename T, bool Value, typename Policy>
+		aggregate(std::vector<signal<T, Value, Policy>> &sources, Op op)
+		: d(new data(std::move(op)))
+		{
+			d->set_self(d);
+
+			std::vector<T> values;
+			values.reserve(sources.size());
+			for (auto &source : sources) {
+				values.push_back(source.sample());
+			}
+			d->op.init(values);
+			d->current_value = d->op.value();
+
+			std::weak_ptr<data> weak = d;
+			d->sources.reserve(sources.size());
+			for (std::size_t i = 0; i < sources.size(); i++) {
+				d->sources.push_back(sources[i].subscribe([weak, i](const T &old_value, const T &new_value) {
+					if (auto self_p = weak.lock()) {
+						self_p->on_commit(i, old_value, new_value);
+					}
+				}));
+			}
+		}
+
+	public:
+		typedef value_type signal_type;
+
+		aggregate(const aggregate &other)
+		: d(other.d)
+		{}
+
+		inline void depend()
+			{ d->depend(); }
+
+		inline operator const value_type&()
+			{ d->depend(); return d->current_value; }
+
+		inline const value_type& sample() const
+			{ note_untracked_read(); return d->current_value; }
+
+		friend std::ostream & operator<<(std::ostream &os, aggregate<Op> &a) {
+			os << a.operator const value_type&();
+			return os;
+		}
+	};
+
+	/*
+		A read-only signal holding the result of a pure function, with an
+		LRU cache of past results. Each run records the signals `fn` read
+		and their values; when the memo is invalidated, the cached entries
+		are checked first, and if every signal an entry read still holds
+		the value it had, its result is used (and its signals subscribed
+		to again) without running `fn`. Runs that read anything but tracked
+		signals, or sample anything, aren't cached.
+	*/
+	template <typename R>
+	class memo {
+		friend class api;
+
+		struct entry {
+			std::vector<std::unique_ptr<memo_read>> reads;
+			R result;
+		};
+
+		struct data : public node {
+			std::weak_ptr<data> self;
+			std::function<R()> fn;
+			std::size_t capacity;
+			/* most recently used first */
+			std::list<entry> cache;
+			R current_value;
+			std::uint64_t hits;
+			std::uint64_t misses;
+			observer_list observers;
+
+			data(std::function<R()> _fn, std::size_t _capacity)
+			: node(node_memo)
+			, fn(std::move(_fn))
+			, capacity(_capacity)
+			, current_value()
+			, hits(0)
+			, misses(0)
+			{}
+
+			data(const data &) = delete;
+			data(data &&) = delete;
+
+			inline void set_self(std::weak_ptr<data> _self) {
+				self = _self;
+
+				this->update = [_self] {
+					if (auto self_p = _self.lock()) {
+						self_p->evaluate();
+					}
+				};
+			}
+
+			inline bool matches(const entry &e) const {
+				for (const auto &read : e.reads) {
+					if (!read->unchanged()) return false;
+				}
+				return true;
+			}
+
+			inline void evaluate() {
+				if (!stale) return;
+				stale = false;
+				failed = false;
+
+				owner_guard og(nullptr);
+				observer_guard obg(self.lock());
+
+				auto itr = cache.begin();
+				while (itr != cache.end() && !matches(*itr)) ++itr;
+
+				if (itr != cache.end()) {
+					++hits;
+					cache.splice(cache.begin(), cache, itr);
+					for (auto &read : itr->reads) {
+						read->depend();
+					}
+					assign(itr->result);
+					return;
+				}
+
+				++misses;
+				memo_recorder recorder(this);
+				R v = record(recorder);
+
+				if (recorder.cacheable && capacity) {
+					cache.push_front(entry{std::move(recorder.reads), v});
+					if (cache.size() > capacity) cache.pop_back();
+				}
+
+				assign(v);
+			}
+
+			/* runs `fn` with its reads recorded into `recorder` */
+			inline R record(memo_recorder &recorder) {
+				recording_guard rg(&recorder);
+				return fn();
+			}
+
+			inline void assign(const R &v) {
+				if (v != current_value) {
+					current_value = v;
+					notify_observers(*this, observers);
+				}
+			}
+
+			inline void depend() {
+				if (system.current_owner) {
+					system.current_owner->adopt(*this, self);
+				}
+
+				if (system.observer) {
+					add_observer(*this, observers, system.observer);
+				}
+			}
+		};
+
+		std::shared_ptr<data> d;
+
+		memo(std::function<R()> fn, std::size_t capacity)
+		: d(new data(std::move(fn), capacity))
+		{
+			d->set_self(d);
+			d->evaluate();
+		}
+
+	public:
+		typedef R signal_type;
+
+		memo(const memo &other)
+		: d(other.d)
+		{}
+
+		inline void depend()
+			{ d->depend(); }
+
+		inline operator const R&()
+			{ d->depend(); return d->current_value; }
+
+		inline const R& sample() const
+			{ note_untracked_read(); return d->current_value; }
+
+		/* re-evaluations answered from the cache, and those that ran `fn` */
+		inline std::uint64_t hits() const
+			{ return d->hits; }
+
+		inline std::uint64_t misses() const
+			{ return d->misses; }
+
+		inline std::size_t cached() const
+			{ return d->cache.size(); }
+
+		friend std::ostream & operator<<(std::ostream &os, memo<R> &m) {
+			os << m.operator const R&();
+			return os;
+		}
+	};
+
+	class signal_root {
+		struct data : public owner {
+			std::shared_ptr<clock> c;
+			std::unique_ptr<sealed_graph> sealed;
+
+			data()
+			: c(std::make_shared<clock>())
+			{
+#ifdef LIBSIG_HEAP_FREE_AFTER_BUILD
+				children.reserve(LIBSIG_MAXROOTCHILDREN);
+#endif
+			}
+		};
+
+		std::shared_ptr<data> d;
+
+	public:
+		signal_root(std::function<void()> fn)
+		: signal_root(std::move(fn), nullptr)
+		{}
+
+		/* installs `on_error` (see `on_error()`) before `fn` runs, so it also sees errors while building */
+		signal_root(std::function<void()> fn, error_boundary on_error)
+		: d(new data())
+		{
+			d->c->on_error = std::move(on_error);
+			owner_guard og(d);
+			context_guard cg(d->c);
+			fn();
+		}
+
+		/* the clock that nodes created within this root are bound to */
+		inline clock & get_clock() const
+			{ return *d->c; }
+
+		/* node, edge, tick and allocation counters of this root's clock */
+		inline const clock_stats & stats() const
+			{ return d->c->stats; }
+
+		/* see `clock::on_settled` */
+		inline subscription on_settled(std::function<void()> fn) const
+			{ return d->c->on_settled(std::move(fn)); }
+
+		/* handles exceptions thrown by nodes created within this root; see `clock::run` */
+		inline void on_error(error_boundary fn) const
+			{ d->c->on_error = std::move(fn); }
+
+		/*
+			Fixes the shape of this root's graph as it stands: everything
+			created within it, and everything its computations have read,
+			joins a sealed graph (see `sealed_graph`). From then on, its
+			computations re-run without releasing children or tracking
+			reads, and its edges are walked from a flat array. Buffers,
+			stores, selectors and signals with ownership off (which no
+			owner adopts, so the root can't find them) stay dynamic. A
+			sealed computation creating a computation or keyed map, and
+			(in debug builds) one reading any other node, is reported as
+			`error_sealed`.
+			Sealing again releases the previous sealed graph (its edges go
+			back to the nodes' observer lists) and captures the graph anew.
+		*/
+		void seal() {
+			if (system.active) {
+				LIBSIG_FAIL(error_sealed, std::logic_error, "roots can only be sealed while no clock is running");
+				return;
+			}
+
+			if (d->sealed) d->sealed->release();
+			d->sealed.reset(new sealed_graph());
+			sealed_graph &g = *d->sealed;
+
+			std::vector<owner *> owners(1, d.get());
+			while (!owners.empty()) {
+				owner *o = owners.back();
+				owners.pop_back();
+
+				for (auto &child : o->children) {
+					if (!g.add(child)) continue;
+					if (child->kind == node_computation || child->kind == node_effect) {
+						owners.push_back(&computation::owner_of(*child));
+					}
+				}
+			}
+		}
+
+		signal_root(const signal_root &other)
+		: d(other.d)
+		{}
+
+		signal_root(signal_root &&other)
+		: d(std::move(other.d))
+		{}
+	};
+
+#ifndef LIBSIG_NO_EXCEPTIONS
+	/*
+		Encodes signal values for snapshots. Trivially copyable types are
+		written as raw blocks; specialize for anything else.
+	*/
+	template <typename T, typename Enable = void>
+	struct serializer;
+
+	template <typename T>
+	struct serializer<T, typename std::enable_if<std::is_trivially_copyable<T>::value>::type> {
+		static inline void write(std::string &out, const T &v)
+			{ out.append(reinterpret_cast<const char *>(&v), sizeof(T)); }
+
+		static inline bool read(const char *data, std::size_t size, T &v) {
+			if (size != sizeof(T)) return false;
+			std::memcpy(&v, data, sizeof(T));
+			return true;
+		}
+	};
+
+	template <>
+	struct serializer<std::string> {
+		static inline void write(std::string &out, const std::string &v)
+			{ out.append(v); }
+
+		static inline bool read(const char *data, std::size_t size, std::string &v) {
+			v.assign(data, size);
+			return true;
+		}
+	};
+
+	/*
+		Maps stable keys to signals so that their current values can be
+		saved to (and restored from) a flat binary snapshot.
+
+		Layout (native endianness, every block padded to 8 bytes):
+
+			char     magic[8]      "LSIGSNAP"
+			uint32_t version
+			uint32_t count
+			count * {
+				uint32_t key_size
+				uint32_t reserved
+				uint64_t value_size
+				char     key[key_size]
+				char     value[value_size]
+			}
+	*/
+	class registry {
+		struct entry {
+			std::string key;
+			std::shared_ptr<node> n;
+			std::function<void(std::string &, const void *)> encode;
+			std::function<void(std::string &)> save;
+			/* decodes a value into a write that schedules it, or returns an empty write */
+			std::function<std::function<void()>(const char *, std::size_t)> decode;
+		};
+
+		friend class recorder;
+		friend class replayer;
+
+		std::vector<entry> entries;
+		std::map<std::string, std::size_t> index;
+		std::map<const node *, std::size_t> by_node;
+
+		static constexpr std::uint32_t version = 1;
+
+		static inline std::size_t padded(std::size_t size)
+			{ return (size + 7) & ~static_cast<std::size_t>(7); }
+
+		static inline void pad(std::string &out)
+			{ out.append(padded(out.size()) - out.size(), '\0'); }
+
+		template <typename U>
+		static inline void put(std::string &out, U v)
+			{ out.append(reinterpret_cast<const char *>(&v), sizeof(U)); }
+
+		template <typename U>
+		static inline U get(const char *&p, const char *end) {
+			U v;
+			if (static_cast<std::size_t>(end - p) < sizeof(U)) {
+				throw std::runtime_error("malformed snapshot");
+			}
+			std::memcpy(&v, p, sizeof(U));
+			p += sizeof(U);
+			return v;
+		}
+
+		static inline const char * skip(const char *p, const char *end, std::uint64_t size) {
+			/* checked before padding, which would wrap for sizes near the limit */
+			std::uint64_t left = static_cast<std::uint64_t>(end - p);
+			if (size > left || padded(static_cast<std::size_t>(size)) > left) {
+				throw std::runtime_error("malformed snapshot");
+			}
+			return p + padded(static_cast<std::size_t>(size));
+		}
+
+	public:
+		template <typename T, bool Value, typename Policy>
+		void add(const std::string &key, signal<T, Value, Policy> &sig) {
+			if (index.count(key)) {
+				throw std::logic_error("duplicate registry key");
+			}
+
+			auto d = sig.d;
+
+			entry e;
+			e.key = key;
+			e.n = d;
+			e.encode = [](std::string &out, const void *value) {
+				serializer<T>::write(out, *static_cast<const T *>(value));
+			};
+			e.save = [d](std::string &out) {
+				serializer<T>::write(out, d->current_value);
+			};
+			e.decode = [d](const char *data, std::size_t size) -> std::function<void()> {
+				T v;
+				if (!serializer<T>::read(data, size, v)) return nullptr;
+				return [d, v] { d->schedule(v); };
+			};
+
+			index[key] = entries.size();
+			by_node[d.get()] = entries.size();
+			entries.push_back(std::move(e));
+		}
+
+		inline std::size_t size() const
+			{ return entries.size(); }
+
+		std::string save() const {
+			std::string out("LSIGSNAP", 8);
+			put<std::uint32_t>(out, version);
+			put<std::uint32_t>(out, static_cast<std::uint32_t>(entries.size()));
+
+			std::string value;
+			for (auto &e : entries) {
+				value.clear();
+				e.save(value);
+
+				put<std::uint32_t>(out, static_cast<std::uint32_t>(e.key.size()));
+				put<std::uint32_t>(out, 0);
+				put<std::uint64_t>(out, value.size());
+				out.append(e.key);
+				pad(out);
+				out.append(value);
+				pad(out);
+			}
+
+			return out;
+		}
+
+		inline void save(std::ostream &os) const {
+			auto out = save();
+			os.write(out.data(), static_cast<std::streamsize>(out.size()));
+		}
+
+		/*
+			Restores every known key within a single freeze, so observers
+			re-run once after all values are in place. Unknown keys are
+			skipped; registered keys missing from the snapshot are left
+			untouched. The whole snapshot is decoded before anything is
+			written, so a malformed one changes nothing.
+		*/
+		void load(const void *data, std::size_t size) {
+			const char *p = static_cast<const char *>(data);
+			const char *end = p + size;
+
+			if (size < 8 || std::memcmp(p, "LSIGSNAP", 8) != 0) {
+				throw std::runtime_error("malformed snapshot");
+			}
+			p += 8;
+
+			if (get<std::uint32_t>(p, end) != version) {
+				throw std::runtime_error("unsupported snapshot version");
+			}
+
+			/* every entry has a header, so a count the data can't hold is rejected before reserving for it */
+			std::uint32_t count = get<std::uint32_t>(p, end);
+			std::size_t header_size = 2 * sizeof(std::uint32_t) + sizeof(std::uint64_t);
+			if (count > static_cast<std::size_t>(end - p) / header_size) {
+				throw std::runtime_error("malformed snapshot");
+			}
+
+			std::vector<std::pair<const entry *, std::pair<const char *, std::size_t>>> pending;
+			pending.reserve(count);
+
+			for (std::uint32_t i = 0; i < count; i++) {
+				std::uint32_t key_size = get<std::uint32_t>(p, end);
+				(void) get<std::uint32_t>(p, end);
+				std::uint64_t value_size = get<std::uint64_t>(p, end);
+
+				const char *key = p;
+				p = skip(p, end, key_size);
+				const char *value = p;
+				p = skip(p, end, value_size);
+
+				auto itr = index.find(std::string(key, key_size));
+				if (itr != index.end()) {
+					pending.push_back(std::make_pair(
+						&entries[itr->second],
+						std::make_pair(value, static_cast<std::size_t>(value_size))));
+				}
+			}
+
+			std::vector<std::function<void()>> writes;
+			writes.reserve(pending.size());
+			for (auto &pv : pending) {
+				writes.push_back(pv.first->decode(pv.second.first, pv.second.second));
+				if (!writes.back()) {
+					throw std::runtime_error("malformed snapshot value for key: " + pv.first->key);
+				}
+			}
+
+			auto fg = current_clock().freeze<true>();
+			for (auto &write : writes) {
+				write();
+			}
+		}
+
+		inline void load(std::istream &is) {
+			std::string buf(
+				(std::istreambuf_iterator<char>(is)),
+				std::istreambuf_iterator<char>());
+			load(buf.data(), buf.size());
+		}
+	};
+
+	/*
+		Logs every external write and freeze boundary made on the thread
+		that created it, whichever clock they go to, to a stream, for
+		later deterministic playback through a `replayer`. Writes made
+		by the graph itself (computations, effects and listeners, which
+		do the same again on replay) aren't external. Only signals known
+		to the registry can be recorded; writes to any others are
+		counted by `unrecorded()`.
+
+		Layout (native endianness):
+
+			char     magic[8]      "LSIGRLOG"
+			uint32_t version
+			uint32_t key_count
+			key_count * { uint32_t size, char key[size] }
+			records... {
+				uint8_t op               1=write, 2=freeze, 3=thaw
+				(op == 1) uint32_t key, uint32_t size, char value[size]
+			}
+	*/
+	class recorder : public clock_tap {
+		const registry &reg;
+		std::ostream &os;
+		clock_tap *prev;
+		std::string buf;
+		std::size_t records;
+		std::size_t dropped;
+
+		inline void flush() {
+			os.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+			buf.clear();
+			++records;
+		}
+
+		/* writes and freezes made by the graph are replayed by the graph itself */
+		static inline bool internal() {
+			return system.observer || (system.active && system.active->settling());
+		}
+
+	public:
+		enum : std::uint8_t {
+			op_write = 1,
+			op_freeze = 2,
+			op_thaw = 3
+		};
+
+		static constexpr std::uint32_t version = 1;
+
+		recorder(const registry &_reg, std::ostream &_os)
+		: reg(_reg)
+		, os(_os)
+		, prev(system.tap)
+		, records(0)
+		, dropped(0)
+		{
+			buf.assign("LSIGRLOG", 8);
+			registry::put<std::uint32_t>(buf, version);
+			registry::put<std::uint32_t>(buf, static_cast<std::uint32_t>(reg.entries.size()));
+			for (auto &e : reg.entries) {
+				registry::put<std::uint32_t>(buf, static_cast<std::uint32_t>(e.key.size()));
+				buf.append(e.key);
+			}
+			os.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+			buf.clear();
+
+			system.tap = this;
+		}
+
+		~recorder() {
+			system.tap = prev;
+		}
+
+		recorder(const recorder &) = delete;
+		recorder(recorder &&) = delete;
+
+		inline std::size_t recorded() const
+			{ return records; }
+
+		inline std::size_t unrecorded() const
+			{ return dropped; }
+
+		void on_write(const node *n, const void *value) override {
+			if (prev) prev->on_write(n, value);
+			if (internal()) return;
+
+			auto itr = reg.by_node.find(n);
+			if (itr == reg.by_node.end()) {
+				++dropped;
+				return;
+			}
+
+			buf.push_back(static_cast<char>(op_write));
+			registry::put<std::uint32_t>(buf, static_cast<std::uint32_t>(itr->second));
+			registry::put<std::uint32_t>(buf, 0);
+			std::size_t start = buf.size();
+			reg.entries[itr->second].encode(buf, value);
+			std::uint32_t size = static_cast<std::uint32_t>(buf.size() - start);
+			std::memcpy(&buf[start - sizeof(size)], &size, sizeof(size));
+			flush();
+		}
+
+		void on_freeze() override {
+			if (prev) prev->on_freeze();
+			if (internal()) return;
+			buf.push_back(static_cast<char>(op_freeze));
+			flush();
+		}
+
+		void on_thaw() override {
+			if (prev) prev->on_thaw();
+			if (internal()) return;
+			buf.push_back(static_cast<char>(op_thaw));
+			flush();
+		}
+	};
+
+	/*
+		Plays a `recorder` log back against a registry, applying writes
+		and freezes in their original order. Keys are matched by name;
+		writes to keys the registry doesn't know are skipped.
+	*/
+	class replayer {
+		typedef std::vector<const registry::entry *> key_list;
+
+		registry &reg;
+
+		template <typename U>
+		static inline U get(const char *&p, const char *end) {
+			if (static_cast<std::size_t>(end - p) < sizeof(U)) {
+				throw std::runtime_error("malformed write log");
+			}
+			return registry::get<U>(p, end);
+		}
+
+		static void apply_write(const char *&p, const char *end, const key_list &keys) {
+			std::uint32_t key = get<std::uint32_t>(p, end);
+			std::uint32_t value_size = get<std::uint32_t>(p, end);
+			if (key >= keys.size() || static_cast<std::size_t>(end - p) < value_size) {
+				throw std::runtime_error("malformed write log");
+			}
+
+			if (keys[key]) {
+				auto write = keys[key]->decode(p, value_size);
+				if (!write) {
+					throw std::runtime_error("malformed write log value for key: " + keys[key]->key);
+				}
+				write();
+			}
+
+			p += value_size;
+		}
+
+		/*
+			Applies the records of a freeze up to its thaw (or the end of
+			the log). Freezes nested in it can't run anything while the
+			caller holds the outer one, so only the caller's guard, thawed
+			once this returns, may rethrow an error; see `clock::run`.
+		*/
+		static void replay_frozen(const char *&p, const char *end, const key_list &keys, std::size_t &applied) {
+			std::vector<std::unique_ptr<clock::freeze_guard<true>>> nested;
+
+			while (p < end) {
+				switch (get<std::uint8_t>(p, end)) {
+				case recorder::op_write:
+					apply_write(p, end, keys);
+					break;
+				case recorder::op_freeze:
+					nested.emplace_back(new clock::freeze_guard<true>(&current_clock()));
+					break;
+				case recorder::op_thaw:
+					++applied;
+					if (nested.empty()) return;
+					nested.pop_back();
+					continue;
+				default:
+					throw std::runtime_error("malformed write log");
+				}
+
+				++applied;
+			}
+		}
+
+	public:
+		replayer(registry &_reg)
+		: reg(_reg)
+		{}
+
+		std::size_t replay(const void *data, std::size_t size) {
+			const char *p = static_cast<const char *>(data);
+			const char *end = p + size;
+
+			if (size < 8 || std::memcmp(p, "LSIGRLOG", 8) != 0) {
+				throw std::runtime_error("malformed write log");
+			}
+			p += 8;
+
+			if (get<std::uint32_t>(p, end) != recorder::version) {
+				throw std::runtime_error("unsupported write log version");
+			}
+
+			/* as in `registry::load`, each key has at least a size to hold */
+			std::uint32_t key_count = get<std::uint32_t>(p, end);
+			if (key_count > static_cast<std::size_t>(end - p) / sizeof(std::uint32_t)) {
+				throw std::runtime_error("malformed write log");
+			}
+
+			key_list keys;
+			keys.reserve(key_count);
+			for (std::uint32_t i = 0; i < key_count; i++) {
+				std::uint32_t key_size = get<std::uint32_t>(p, end);
+				if (static_cast<std::size_t>(end - p) < key_size) {
+					throw std::runtime_error("malformed write log");
+				}
+
+				auto itr = reg.index.find(std::string(p, key_size));
+				keys.push_back(itr == reg.index.end() ? nullptr : &reg.entries[itr->second]);
+				p += key_size;
+			}
+
+			std::size_t applied = 0;
+
+			while (p < end) {
+				switch (get<std::uint8_t>(p, end)) {
+				case recorder::op_write:
+					apply_write(p, end, keys);
+					++applied;
+					break;
+				case recorder::op_freeze: {
+					++applied;
+					/* thawed here, so an error from the batch propagates from `replay()` */
+					clock::freeze_guard<true> fg(&current_clock());
+					replay_frozen(p, end, keys, applied);
+					break;
+				}
+				default:
+					throw std::runtime_error("malformed write log");
+				}
+			}
+
+			return applied;
+		}
+
+		inline std::size_t replay(std::istream &is) {
+			std::string buf(
+				(std::istreambuf_iterator<char>(is)),
+				std::istreambuf_iterator<char>());
+			return replay(buf.data(), buf.size());
+		}
+	};
+#endif
+
+	/*
+		A single-writer sequence lock over a trivially copyable value.
+		Writers never wait; readers retry while a write is in progress.
+		The version is the number of completed writes.
+	*/
+	template <typename T>
+	struct seqlock {
+		static_assert(std::is_trivially_copyable<T>::value, "seqlock values must be trivially copyable");
+
+		/* the value is copied word-wise through relaxed atomics, so torn reads are detectable but never racy */
+		static constexpr std::size_t word_count = (sizeof(T) + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t);
+
+		std::atomic<std::uint64_t> seq;
+		std::atomic<std::uint64_t> words[word_count];
+
+		seqlock(const T &v = T())
+		: seq(0)
+		{
+			std::uint64_t buf[word_count] = {};
+			std::memcpy(buf, &v, sizeof(T));
+			for (std::size_t i = 0; i < word_count; i++) {
+				words[i].store(buf[i], std::memory_order_relaxed);
+			}
+		}
+
+		inline void store(const T &v) {
+			std::uint64_t buf[word_count] = {};
+			std::memcpy(buf, &v, sizeof(T));
+
+			std::uint64_t s = seq.load(std::memory_order_relaxed);
+			seq.store(s + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			for (std::size_t i = 0; i < word_count; i++) {
+				words[i].store(buf[i], std::memory_order_relaxed);
+			}
+			seq.store(s + 2, std::memory_order_release);
+		}
+
+		inline std::uint64_t load(T &out) const {
+			std::uint64_t buf[word_count];
+
+			for (;;) {
+				std::uint64_t s1 = seq.load(std::memory_order_acquire);
+				if (s1 & 1) continue;
+				for (std::size_t i = 0; i < word_count; i++) {
+					buf[i] = words[i].load(std::memory_order_relaxed);
+				}
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if (seq.load(std::memory_order_relaxed) == s1) {
+					std::memcpy(&out, buf, sizeof(T));
+					return s1 / 2;
+				}
+			}
+		}
+
+		inline std::uint64_t version() const
+			{ return seq.load(std::memory_order_acquire) / 2; }
+	};
+
+	/*
+		Holds the latest published value of a signal for readers on other
+		threads. Trivially copyable values sit behind a seqlock; anything
+		else is swapped in as an immutable shared_ptr.
+	*/
+	template <typename T, bool Trivial = std::is_trivially_copyable<T>::value>
+	class publish_slot {
+		seqlock<T> lock;
+
+	public:
+		publish_slot(const T &v)
+		: lock(v)
+		{}
+
+		inline void store(const T &v)
+			{ lock.store(v); }
+
+		inline T load() const {
+			T v;
+			lock.load(v);
+			return v;
+		}
+
+		inline std::uint64_t version() const
+			{ return lock.version(); }
+	};
 
-		signal(std::shared_ptr<data> _d)
-		: d(_d)
-		{}
+	template <typename T>
+	class publish_slot<T, false> {
+		std::shared_ptr<const T> value;
+		std::atomic<std::uint64_t> stores;
 
 	public:
-		typedef T signal_type;
+		publish_slot(const T &v)
+		: value(std::make_shared<const T>(v))
+		, stores(0)
+		{}
 
-		signal()
-		: d(new data())
-		{
-			d->set_self(d);
+		inline void store(const T &v) {
+			std::atomic_store(&value, std::shared_ptr<const T>(std::make_shared<const T>(v)));
+			stores.fetch_add(1, std::memory_order_release);
 		}
 
-		explicit signal(const T &v)
-		: d(new data(v))
+		inline std::shared_ptr<const T> load_shared() const
+			{ return std::atomic_load(&value); }
+
+		inline T load() const
+			{ return *load_shared(); }
+
+		inline std::uint64_t version() const
+			{ return stores.load(std::memory_order_acquire); }
+	};
+
+	/*
+		A thread-safe view of a signal's committed value, created with
+		`S.publish(sig)`. The owning thread copies each committed value
+		into the slot on the tick after it changes; any thread holding
+		a copy of the handle may then read it without ever blocking the
+		owning thread.
+	*/
+	template <typename T>
+	class published {
+		friend class api;
+
+		struct publisher : public node {
+			std::weak_ptr<publisher> self;
+			std::function<const T &()> read;
+			publish_slot<T> slot;
+
+			publisher(std::function<const T &()> _read, const T &v)
+			: node(node_publisher)
+			, read(std::move(_read))
+			, slot(v)
+			{}
+
+			inline void set_self(std::weak_ptr<publisher> _self) {
+				self = _self;
+
+				this->update = [_self] {
+					if (auto self_p = _self.lock()) {
+						self_p->publish();
+					}
+				};
+			}
+
+			/* the initial run only subscribes; the slot already holds the value */
+			inline void publish(bool initial = false) {
+				if (!stale) return;
+				stale = false;
+
+				owner_guard og(nullptr);
+				observer_guard obg(self.lock());
+				const T &v = read();
+				if (!initial) slot.store(v);
+			}
+		};
+
+		std::shared_ptr<publisher> p;
+
+		template <bool Value, typename Policy>
+		published(signal<T, Value, Policy> &sig)
 		{
-			d->set_self(d);
+			signal<T, Value, Policy> source(sig);
+			p = std::make_shared<publisher>(
+				[source]() mutable -> const T & { return source.operator T&(); },
+				sig.sample());
+			p->set_self(p);
+			p->publish(true);
 		}
 
-		explicit signal(const signal<T, Value> &other)
-		: d(other.d)
+	public:
+		published(const published &other)
+		: p(other.p)
 		{}
 
-		inline void depend()
-			{ d->depend(); }
+		/* safe to call from any thread */
+		inline T load() const
+			{ return p->slot.load(); }
 
-		inline operator T&()
-			{ return d->operator T&(); }
+		/* the number of values published since creation */
+		inline std::uint64_t version() const
+			{ return p->slot.version(); }
 
-		inline T* operator ->()
-			{ return d->operator ->(); }
+		/* available for non-trivially copyable types only */
+		template <typename U = T>
+		inline auto load_shared() const
+			-> decltype(std::declval<const publish_slot<U> &>().load_shared())
+			{ return p->slot.load_shared(); }
+	};
 
-		template <typename U, bool V>
-		inline signal<T, Value> & operator =(signal<U, V> &sig)
-			{ d->schedule(sig.operator U&()); return *this; }
+#ifdef LIBSIG_SHM
+	/*
+		A POSIX shared memory segment holding a seqlock-protected value.
+		The creating side unlinks the segment when it is destroyed.
+	*/
+	template <typename T>
+	class shm_segment {
+		struct layout {
+			std::uint64_t magic;
+			std::uint64_t size;
+			seqlock<T> lock;
+		};
 
-		inline signal<T, Value> & operator =(const T &v)
-			{ d->schedule(v); return *this; }
+		static constexpr std::uint64_t segment_magic = 0x4c53494753484d31ull; /* LSIGSHM1 */
 
-		inline T& sample()
-			{ return d->sample(); }
+		std::string name;
+		layout *mem;
+		bool created;
 
-		inline const T& sample() const
-			{ return d->sample(); }
+		static inline std::system_error error(const char *what)
+			{ return std::system_error(errno, std::generic_category(), what); }
 
-#		define LIBSIG_SIG_OP(op) \
-			template <typename U> \
-			inline auto operator op(const U &other) \
-				-> decltype(d->operator op(other)) \
-				{ return d->operator op(other); } \
-			template <typename U, bool V> \
-			inline auto operator op(signal<U, V> &other) \
-				-> decltype(d->operator op(other.operator U&())) \
-				{ return d->operator op(other.operator U&()); }
+	public:
+		/* creates (or replaces) the segment */
+		shm_segment(const std::string &_name, const T &v)
+		: name(_name)
+		, mem(nullptr)
+		, created(true)
+		{
+			int fd = ::shm_open(name.c_str(), O_CREAT | O_RDWR, 0600);
+			if (fd == -1) throw error("shm_open");
 
-		LIBSIG_SIG_OP(==)
-		LIBSIG_SIG_OP(!=)
-		LIBSIG_SIG_OP(*)
-		LIBSIG_SIG_OP(/)
-		LIBSIG_SIG_OP(+)
-		LIBSIG_SIG_OP(-)
-		LIBSIG_SIG_OP(%)
-		LIBSIG_SIG_OP(^)
-		LIBSIG_SIG_OP(&)
-		LIBSIG_SIG_OP(|)
+			if (::ftruncate(fd, sizeof(layout)) == -1) {
+				auto err = error("ftruncate");
+				::close(fd);
+				throw err;
+			}
 
-#		undef LIBSIG_SIG_OP
+			void *addr = ::mmap(nullptr, sizeof(layout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			::close(fd);
+			if (addr == MAP_FAILED) throw error("mmap");
 
-		friend std::ostream & operator<<(std::ostream &os, signal<T, Value> &sig) {
-			os << sig.operator T&();
-			return os;
+			mem = static_cast<layout *>(addr);
+			mem->size = sizeof(T);
+			new (&mem->lock) seqlock<T>(v);
+			std::atomic_thread_fence(std::memory_order_release);
+			mem->magic = segment_magic;
 		}
-	};
 
-	class computation {
-		friend class api;
+		/* opens an existing segment read-only */
+		explicit shm_segment(const std::string &_name)
+		: name(_name)
+		, mem(nullptr)
+		, created(false)
+		{
+			int fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+			if (fd == -1) throw error("shm_open");
 
-		struct data : public node, public owner {
-			std::weak_ptr<data> self;
-			std::function<void()> fn;
-			std::list<std::weak_ptr<node>> observers;
+			struct stat st;
+			if (::fstat(fd, &st) == -1 || static_cast<std::size_t>(st.st_size) < sizeof(layout)) {
+				::close(fd);
+				throw std::runtime_error("shared memory segment is not initialized: " + name);
+			}
 
-			data(std::function<void()> _fn)
-			: fn(_fn)
-			{}
+			void *addr = ::mmap(nullptr, sizeof(layout), PROT_READ, MAP_SHARED, fd, 0);
+			::close(fd);
+			if (addr == MAP_FAILED) throw error("mmap");
 
-			inline void depend() {
-				if (system.observer) {
-					observers.push_back(system.observer);
-				}
+			mem = static_cast<layout *>(addr);
+			if (mem->magic != segment_magic || mem->size != sizeof(T)) {
+				::munmap(mem, sizeof(layout));
+				throw std::runtime_error("shared memory segment has an unexpected layout: " + name);
 			}
+		}
 
-			inline void schedule_all_observers()
-				{ system.root_clock.consume_and_schedule_all(observers); }
+		~shm_segment() {
+			::munmap(mem, sizeof(layout));
+			if (created) ::shm_unlink(name.c_str());
+		}
 
-			inline void set_self(std::weak_ptr<data> _self) {
+		shm_segment(const shm_segment &) = delete;
+		shm_segment(shm_segment &&) = delete;
+
+		inline void store(const T &v)
+			{ mem->lock.store(v); }
+
+		inline std::uint64_t load(T &out) const
+			{ return mem->lock.load(out); }
+
+		inline std::uint64_t version() const
+			{ return mem->lock.version(); }
+	};
+
+	/*
+		A `val<T>` whose committed value is also published to a shared
+		memory segment, for `shm_consumer`s in other processes on the same
+		host. Publishing happens on the tick after each change.
+	*/
+	template <typename T>
+	class shm_signal : public signal<T, true> {
+		struct publisher : public node {
+			std::weak_ptr<publisher> self;
+			signal<T, true> source;
+			shm_segment<T> segment;
+
+			publisher(const signal<T, true> &_source, const std::string &name)
+			: node(node_publisher)
+			, source(_source)
+			, segment(name, _source.sample())
+			{}
+
+			inline void set_self(std::weak_ptr<publisher> _self) {
 				self = _self;
 
 				this->update = [_self] {
 					if (auto self_p = _self.lock()) {
-						self_p->recompute();
+						self_p->publish();
 					}
 				};
 			}
 
-			void recompute() {
-				if (auto self_p = self.lock()) {
-					if (stale) {
-						stale = false;
-						children.clear();
-						owner_guard og(self_p);
-						observer_guard obg(self_p);
-						fn();
-						schedule_all_observers();
-					}
-				}
-			}
+			inline void publish() {
+				if (!stale) return;
+				stale = false;
 
-			inline void schedule_self()
-				{ system.root_clock.schedule_one(self); }
+				owner_guard og(nullptr);
+				observer_guard obg(self.lock());
+				segment.store(source.operator T&());
+			}
 		};
 
-		std::shared_ptr<data> d;
+		std::shared_ptr<publisher> p;
 
-		computation(std::function<void()> fn)
-		: d(new data(fn))
+	public:
+		explicit shm_signal(const std::string &name, const T &v = T())
+		: signal<T, true>(v)
+		, p(new publisher(*this, name))
 		{
-			d->set_self(d);
+			p->set_self(p);
+			p->publish();
+		}
 
-			if (system.current_owner) {
-				system.current_owner->children.insert(d);
-			} else {
-				throw std::logic_error("computations must be created from within a sig_root context");
-			}
+		shm_signal(const shm_signal &other)
+		: signal<T, true>(other)
+		, p(other.p)
+		{}
 
-			d->schedule_self();
-		}
+		using signal<T, true>::operator =;
+
+		inline std::uint64_t version() const
+			{ return p->segment.version(); }
+	};
+
+	/*
+		Reads values published by `shm_signal`s into local signals. Each
+		`poll()` checks every opened segment's version and writes all
+		changed values within a single freeze of the current clock.
+	*/
+	class shm_consumer {
+		struct entry {
+			std::function<bool()> poll;
+		};
+
+		std::vector<entry> entries;
 
 	public:
-		computation(const computation &other)
-		: d(other.d)
-		{}
+		/* binds `local` to the segment, writing its current value */
+		template <typename T, bool Value, typename Policy>
+		void open(const std::string &name, signal<T, Value, Policy> &local) {
+			auto segment = std::make_shared<shm_segment<T>>(name);
+			auto version = std::make_shared<std::uint64_t>(0);
+
+			entry e;
+			e.poll = [segment, version, local]() mutable {
+				T next;
+				std::uint64_t v = segment->load(next);
+				if (v == *version) return false;
+				*version = v;
+				local = next;
+				return true;
+			};
+
+			e.poll();
+			entries.push_back(std::move(e));
+		}
+
+		/* returns the number of segments that changed */
+		std::size_t poll() {
+			std::size_t changed = 0;
+			auto fg = current_clock().freeze<true>();
+			for (auto &e : entries) {
+				if (e.poll()) ++changed;
+			}
+			return changed;
+		}
 	};
+#endif
 
-	class signal_root {
-		struct data : public owner {};
-		std::shared_ptr<data> d;
+#ifdef LIBSIG_EVENTFD
+	/*
+		Hands writes from other threads to the thread driving a clock, for
+		epoll (or poll/select) based loops. `post()` may be called from
+		any thread; `fd()` becomes readable once anything is pending, with
+		a single wakeup until the next `drain()`. `drain()` is called from
+		the driving thread and applies everything posted so far, plus any
+		due timers of the attached timer queue, within a single freeze,
+		so each loop iteration propagates once; as in any freeze, writes
+		to the same signal conflict unless its policy turns that off. Use
+		`timeout()` as the epoll_wait timeout so timers are drained when
+		due.
+	*/
+	class event_bridge {
+		int efd;
+		timer_queue *timers;
+		std::mutex lock;
+		std::vector<std::function<void()>> pending;
+		/* the batch being applied; kept so its storage is reused by the next one */
+		std::vector<std::function<void()>> applying;
+
+		static inline std::system_error error(const char *what)
+			{ return std::system_error(errno, std::generic_category(), what); }
+
+		void open() {
+			efd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+			if (efd == -1) throw error("eventfd");
+		}
 
 	public:
-		signal_root(std::function<void()> fn)
-		: d(new data())
+		event_bridge()
+		: timers(nullptr)
 		{
-			owner_guard og(d);
-			fn();
+			open();
 		}
 
-		signal_root(const signal_root &other)
-		: d(other.d)
-		{}
+		explicit event_bridge(timer_queue &_timers)
+		: timers(&_timers)
+		{
+			open();
+		}
 
-		signal_root(signal_root &&other)
-		: d(std::move(other.d))
-		{}
+		~event_bridge() {
+			::close(efd);
+		}
+
+		event_bridge(const event_bridge &) = delete;
+		event_bridge(event_bridge &&) = delete;
+
+		inline int fd() const
+			{ return efd; }
+
+		/* queues `fn` to run within the next drain */
+		template <typename Fn>
+		void post(Fn fn) {
+			bool wake;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				wake = pending.empty();
+				pending.emplace_back(std::move(fn));
+			}
+
+			if (wake) {
+				std::uint64_t one = 1;
+				/* can only fail if the counter would overflow, in which case the fd is readable anyway */
+				ssize_t written = ::write(efd, &one, sizeof(one));
+				(void) written;
+			}
+		}
+
+		/* queues a write of `value` to `sig` */
+		template <typename T, bool Value, typename Policy, typename U>
+		void post(signal<T, Value, Policy> &sig, U &&value) {
+			signal<T, Value, Policy> target(sig);
+			T v(std::forward<U>(value));
+			post([target, v]() mutable { target = v; });
+		}
+
+		/*
+			Milliseconds until the next timer is due (rounded up), 0 if one
+			is already due, or -1 if there is none (or no timer queue).
+		*/
+		int timeout() {
+			if (!timers || !timers->size()) return -1;
+
+			auto left = timers->next_deadline() - timers->now();
+			if (left <= duration::zero()) return 0;
+			auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(left + std::chrono::milliseconds(1) - duration(1));
+			return static_cast<int>(ms.count());
+		}
+
+		/*
+			Returns the number of posted writes and timers that ran. If a
+			posted fn throws, the rest of its batch is dropped (what ran
+			so far is still applied) and the exception propagates.
+		*/
+		std::size_t drain() {
+			/* reset before taking the batch, so a post racing with it still wakes the next wait */
+			std::uint64_t count;
+			ssize_t got = ::read(efd, &count, sizeof(count));
+			(void) got;
+
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				applying.swap(pending);
+			}
+
+			/* emptied even if a fn throws, so the batch can't be swapped back in and run again */
+			struct clear_guard {
+				std::vector<std::function<void()>> &batch;
+				~clear_guard() { batch.clear(); }
+			} cg{applying};
+
+			std::size_t ran = applying.size();
+			auto fg = current_clock().freeze<true>();
+			for (auto &fn : applying) {
+				fn();
+			}
+
+			if (timers) ran += timers->poll();
+			return ran;
+		}
 	};
+#endif
 
 	class api {
 		template<typename T, bool Value>
@@ -489,24 +4510,221 @@ namespace detail {
 
 	public:
 		auto operator()(std::function<void()> fn) -> computation {
-			return computation(fn);
+			return computation(std::move(fn), node_computation);
+		}
+
+		/* a computation whose exceptions go to `on_error` (see `clock::run`) */
+		auto operator()(std::function<void()> fn, error_boundary on_error) -> computation {
+			return computation(std::move(fn), node_computation, std::move(on_error));
+		}
+
+		/*
+			A computation for side effects: it's only run once the batch
+			that reached it has settled, and then only once.
+		*/
+		auto effect(std::function<void()> fn) -> computation {
+			return computation(std::move(fn), node_effect);
+		}
+
+		template <typename E>
+		auto derive(const expression<E> &x) -> derived<E> {
+			return derived<E>(x.e);
+		}
+
+		template <typename K, bool Value, typename Policy>
+		auto selector(signal<K, Value, Policy> &source) -> detail::selector<K, Value, Policy> {
+			return detail::selector<K, Value, Policy>(source);
+		}
+
+		template <typename T, bool Value, typename Policy>
+		auto publish(signal<T, Value, Policy> &sig) -> published<T> {
+			return published<T>(sig);
+		}
+
+		template <typename T, bool Value, typename Policy, typename KeyFn, typename ChildFn>
+		auto map_keyed(signal<std::vector<T>, Value, Policy> &list, KeyFn key_fn, ChildFn child_fn)
+			-> keyed_map<T, typename std::decay<decltype(key_fn(std::declval<const T &>()))>::type>
+		{
+			typedef typename std::decay<decltype(key_fn(std::declval<const T &>()))>::type K;
+			return keyed_map<T, K>(list, std::move(key_fn), std::move(child_fn));
+		}
+
+		/* see `timed_mode` */
+		template <typename T, bool Value, typename Policy>
+		auto throttle(signal<T, Value, Policy> &sig, duration interval, timer_queue &timers) -> timed<T> {
+			return timed<T>(sig, timed_throttle, interval, timers);
+		}
+
+		template <typename T, bool Value, typename Policy>
+		auto debounce(signal<T, Value, Policy> &sig, duration interval, timer_queue &timers) -> timed<T> {
+			return timed<T>(sig, timed_debounce, interval, timers);
+		}
+
+		template <typename T, bool Value, typename Policy>
+		auto sample(signal<T, Value, Policy> &sig, duration interval, timer_queue &timers) -> timed<T> {
+			return timed<T>(sig, timed_sample, interval, timers);
+		}
+
+		/* see `memo`; `fn` must be pure */
+		template <typename Fn>
+		auto memoize(Fn fn, std::size_t capacity = 8) -> memo<typename std::decay<decltype(fn())>::type> {
+			return memo<typename std::decay<decltype(fn())>::type>(std::move(fn), capacity);
+		}
+
+		/* see `aggregate`; sources must not be added to or removed from afterwards */
+		template <typename T, bool Value, typename Policy>
+		auto sum(std::vector<signal<T, Value, Policy>> &sources) -> aggregate<aggregate_sum<T>> {
+			return aggregate<aggregate_sum<T>>(sources, aggregate_sum<T>());
 		}
 
-		void freeze(std::function<void()> fn) {
-			auto fg = system.root_clock.freeze<true>();
+		template <typename T, bool Value, typename Policy, typename Pred>
+		auto count(std::vector<signal<T, Value, Policy>> &sources, Pred pred) -> aggregate<aggregate_count<T>> {
+			return aggregate<aggregate_count<T>>(sources, aggregate_count<T>(std::move(pred)));
+		}
+
+		template <typename T, bool Value, typename Policy>
+		auto min(std::vector<signal<T, Value, Policy>> &sources) -> aggregate<aggregate_extreme<T, std::less<T>>> {
+			return aggregate<aggregate_extreme<T, std::less<T>>>(sources, aggregate_extreme<T, std::less<T>>());
+		}
+
+		template <typename T, bool Value, typename Policy>
+		auto max(std::vector<signal<T, Value, Policy>> &sources) -> aggregate<aggregate_extreme<T, std::greater<T>>> {
+			return aggregate<aggregate_extreme<T, std::greater<T>>>(sources, aggregate_extreme<T, std::greater<T>>());
+		}
+
+		template <typename T, bool Value, typename Policy, typename Fn>
+		auto watch(signal<T, Value, Policy> &sig, Fn fn) -> subscription {
+			return sig.subscribe(std::move(fn));
+		}
+
+		/* takes any callable, so batching a write doesn't allocate a closure */
+		template <typename Fn>
+		void freeze(Fn &&fn) {
+			auto fg = current_clock().freeze<true>();
 			fn();
 		}
+
+		/* constructs a graph in bulk; see `clock::build` */
+		void build(std::function<void()> fn) {
+			current_clock().build(fn);
+		}
+
+		/* the counters of the clock that batches on this thread apply to */
+		const clock_stats & stats() {
+			return current_clock().stats;
+		}
+
+		/* see `clock::on_settled` */
+		subscription on_settled(std::function<void()> fn) {
+			return current_clock().on_settled(std::move(fn));
+		}
 	};
 }}
 
 namespace libsig {
+	template <bool Tracking = true, bool Ownership = true, bool Conflicts = true>
+	using sig_policy = detail::signal_policy<Tracking, Ownership, Conflicts>;
+	template <typename T, typename Policy = sig_policy<>>
+	using sig = detail::signal<T, false, Policy>;
+	template <typename T, typename Policy = sig_policy<>>
+	using val = detail::signal<T, true, Policy>;
 	template <typename T>
-	using sig = detail::signal<T>;
+	using sig_buffer = detail::signal_buffer<T>;
+	template <typename T, std::size_t N>
+	using sig_array = detail::signal_array<T, N>;
 	template <typename T>
-	using val = detail::signal<T, true>;
+	using sig_store = detail::store<T>;
 	using computation = detail::computation;
+	using subscription = detail::subscription;
 	using sig_root = detail::signal_root;
+	using sig_stats = detail::clock_stats;
+	using sig_timers = detail::timer_queue;
+	using steady_time = detail::steady_time;
+	using manual_time = detail::manual_time;
+	using sig_error = detail::error_code;
+	using sig_error_boundary = detail::error_boundary;
+	using sig_error_handler = detail::error_handler;
+	using detail::set_error_handler;
+#ifndef LIBSIG_NO_EXCEPTIONS
+	using sig_registry = detail::registry;
+	using sig_recorder = detail::recorder;
+	using sig_replayer = detail::replayer;
+#endif
+	using detail::expr;
+	template <typename T>
+	using published = detail::published<T>;
+#ifdef LIBSIG_SHM
+	template <typename T>
+	using shm_val = detail::shm_signal<T>;
+	using shm_consumer = detail::shm_consumer;
+#endif
+#ifdef LIBSIG_EVENTFD
+	using sig_bridge = detail::event_bridge;
+#endif
 	static detail::api S;
 }
 
+#if defined(LIBSIG_MAIN) && defined(LIBSIG_ALLOC_STATS)
+/*
+	Replaced together (including the nothrow and array forms, which
+	a sanitizer may otherwise provide), so that what these return is
+	always released with free(). They're kept out of line, or GCC may
+	see the pairing and report a mismatched deallocation.
+*/
+#if defined(__GNUC__)
+#	define LIBSIG_NOINLINE __attribute__((noinline))
+#else
+#	define LIBSIG_NOINLINE
+#endif
+
+LIBSIG_NOINLINE void * operator new(std::size_t n) {
+	libsig::detail::note_allocation(n);
+	if (void *p = std::malloc(n ? n : 1)) return p;
+#ifdef LIBSIG_NO_EXCEPTIONS
+	std::abort();
+#else
+	throw std::bad_alloc();
+#endif
+}
+
+LIBSIG_NOINLINE void operator delete(void *p) noexcept {
+	std::free(p);
+}
+
+LIBSIG_NOINLINE void operator delete(void *p, std::size_t) noexcept {
+	std::free(p);
+}
+
+LIBSIG_NOINLINE void * operator new(std::size_t n, const std::nothrow_t &) noexcept {
+	libsig::detail::note_allocation(n);
+	return std::malloc(n ? n : 1);
+}
+
+LIBSIG_NOINLINE void operator delete(void *p, const std::nothrow_t &) noexcept {
+	std::free(p);
+}
+
+LIBSIG_NOINLINE void * operator new[](std::size_t n) {
+	return operator new(n);
+}
+
+LIBSIG_NOINLINE void * operator new[](std::size_t n, const std::nothrow_t &tag) noexcept {
+	return operator new(n, tag);
+}
+
+LIBSIG_NOINLINE void operator delete[](void *p) noexcept {
+	std::free(p);
+}
+
+LIBSIG_NOINLINE void operator delete[](void *p, std::size_t) noexcept {
+	std::free(p);
+}
+
+LIBSIG_NOINLINE void operator delete[](void *p, const std::nothrow_t &) noexcept {
+	std::free(p);
+}
+
+#undef LIBSIG_NOINLINE
+#endif
+
 #endif
@@ -0,0 +1,240 @@
+/*
+	Builds a random reactive graph and reports how it scales: build time,
+	write-to-settled latency percentiles, peak RSS and teardown time, as
+	a single JSON object on stdout.
+
+	    libsig-stress [--sources=N] [--nodes=N] [--depth=N] [--fanin=N]
+	                  [--dynamic=RATIO] [--writes=N] [--seed=N] [--bulk=0|1]
+
+	The graph has `sources` input signals followed by `depth` layers of
+	computations (`nodes` in total), each writing its own output signal.
+	Every computation reads `fanin` signals chosen at random from the
+	layers before it; fan-out follows from that. A `dynamic` fraction of
+	them read a control input first and, depending on its value, one of
+	two different input sets, so their dependencies change between runs.
+	With `bulk`, the graph is built within `S.build()`.
+*/
+
+#define LIBSIG_MAIN
+#define LIBSIG_RUNAWAYTHRESH 1000000
+#include <sig.hh>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#	include <sys/resource.h>
+#endif
+
+using namespace libsig;
+
+typedef std::int64_t value_t;
+typedef std::chrono::steady_clock steady;
+
+struct config {
+	std::size_t sources = 1000;
+	std::size_t nodes = 100000;
+	std::size_t depth = 10;
+	std::size_t fanin = 3;
+	double dynamic = 0.1;
+	std::size_t writes = 10000;
+	unsigned seed = 1;
+	bool bulk = false;
+};
+
+static bool parse_arg(const char *arg, config &cfg) {
+	const char *eq = std::strchr(arg, '=');
+	if (std::strncmp(arg, "--", 2) != 0 || !eq) return false;
+
+	std::string key(arg + 2, eq);
+	const char *value = eq + 1;
+
+	if (key == "sources") cfg.sources = std::strtoull(value, nullptr, 10);
+	else if (key == "nodes") cfg.nodes = std::strtoull(value, nullptr, 10);
+	else if (key == "depth") cfg.depth = std::strtoull(value, nullptr, 10);
+	else if (key == "fanin") cfg.fanin = std::strtoull(value, nullptr, 10);
+	else if (key == "dynamic") cfg.dynamic = std::strtod(value, nullptr);
+	else if (key == "writes") cfg.writes = std::strtoull(value, nullptr, 10);
+	else if (key == "seed") cfg.seed = static_cast<unsigned>(std::strtoul(value, nullptr, 10));
+	else if (key == "bulk") cfg.bulk = std::strtoul(value, nullptr, 10) != 0;
+	else return false;
+
+	return true;
+}
+
+static double elapsed_ms(steady::time_point since) {
+	return std::chrono::duration<double, std::milli>(steady::now() - since).count();
+}
+
+static long peak_rss_kb() {
+#ifndef _WIN32
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#	ifdef __APPLE__
+		return usage.ru_maxrss / 1024;
+#	else
+		return usage.ru_maxrss;
+#	endif
+	}
+#endif
+	return -1;
+}
+
+static double percentile(const std::vector<double> &sorted, double p) {
+	if (sorted.empty()) return 0;
+	std::size_t i = static_cast<std::size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+	return sorted[i];
+}
+
+struct graph {
+	std::vector<std::unique_ptr<val<value_t>>> signals;
+	std::unique_ptr<sig_root> root;
+	std::size_t dynamic_nodes = 0;
+
+	void build(const config &cfg, std::mt19937 &rng) {
+		root.reset(new sig_root([&] {
+			if (cfg.bulk) {
+				S.build([&] { build_layers(cfg, rng); });
+			} else {
+				build_layers(cfg, rng);
+			}
+		}));
+	}
+
+	void build_layers(const config &cfg, std::mt19937 &rng) {
+		signals.reserve(cfg.sources + cfg.nodes);
+		for (std::size_t i = 0; i < cfg.sources; i++) {
+			signals.emplace_back(new val<value_t>(static_cast<value_t>(i)));
+		}
+
+		std::uniform_real_distribution<double> coin(0, 1);
+		std::size_t depth = cfg.depth ? cfg.depth : 1;
+
+		for (std::size_t layer = 0; layer < depth; layer++) {
+			/* spread the remainder over the first layers */
+			std::size_t count = cfg.nodes / depth + (layer < cfg.nodes % depth ? 1 : 0);
+			std::size_t available = signals.size();
+			std::uniform_int_distribution<std::size_t> pick(0, available - 1);
+
+			for (std::size_t n = 0; n < count; n++) {
+				bool dynamic = coin(rng) < cfg.dynamic;
+				std::size_t reads = cfg.fanin * (dynamic ? 2 : 1) + (dynamic ? 1 : 0);
+
+				std::vector<val<value_t>> inputs;
+				inputs.reserve(reads);
+				for (std::size_t r = 0; r < reads; r++) {
+					inputs.emplace_back(*signals[pick(rng)]);
+				}
+
+				signals.emplace_back(new val<value_t>());
+				val<value_t> out(*signals.back());
+				std::size_t fanin = cfg.fanin;
+
+				if (dynamic) {
+					++dynamic_nodes;
+					S([=]() mutable {
+						/* inputs[0] picks which half of the rest is read */
+						value_t control = inputs[0];
+						std::size_t base = 1 + ((control & 1) ? fanin : 0);
+						value_t sum = 0;
+						for (std::size_t r = 0; r < fanin; r++) {
+							sum += inputs[base + r];
+						}
+						out = sum % 1000003;
+					});
+				} else {
+					S([=]() mutable {
+						value_t sum = 0;
+						for (auto &in : inputs) {
+							sum += in;
+						}
+						out = sum % 1000003;
+					});
+				}
+			}
+		}
+	}
+};
+
+int main(int argc, char **argv) {
+	config cfg;
+	for (int i = 1; i < argc; i++) {
+		if (!parse_arg(argv[i], cfg)) {
+			std::fprintf(stderr, "libsig-stress: unknown argument: %s\n", argv[i]);
+			return 2;
+		}
+	}
+
+	if (!cfg.sources) {
+		std::fprintf(stderr, "libsig-stress: --sources must be at least 1\n");
+		return 2;
+	}
+
+	std::mt19937 rng(cfg.seed);
+	graph g;
+
+	auto build_start = steady::now();
+	g.build(cfg, rng);
+	double build_ms = elapsed_ms(build_start);
+
+	const sig_stats &stats = g.root->stats();
+	std::uint64_t build_updates = stats.updates;
+	std::size_t live_nodes = stats.live_nodes();
+	std::size_t edges = stats.edges;
+	std::uint64_t updates_before = stats.updates;
+	std::uint64_t ticks_before = stats.ticks;
+
+	std::vector<double> latencies;
+	latencies.reserve(cfg.writes);
+	std::uniform_int_distribution<std::size_t> pick_source(0, cfg.sources - 1);
+
+	for (std::size_t w = 0; w < cfg.writes; w++) {
+		val<value_t> &source = *g.signals[pick_source(rng)];
+		value_t next = source.sample() + 1;
+
+		auto start = steady::now();
+		source = next;
+		latencies.push_back(std::chrono::duration<double, std::micro>(steady::now() - start).count());
+	}
+
+	double updates_per_write = cfg.writes
+		? static_cast<double>(stats.updates - updates_before) / static_cast<double>(cfg.writes)
+		: 0;
+	double ticks_per_write = cfg.writes
+		? static_cast<double>(stats.ticks - ticks_before) / static_cast<double>(cfg.writes)
+		: 0;
+
+	std::sort(latencies.begin(), latencies.end());
+	long rss_kb = peak_rss_kb();
+
+	auto teardown_start = steady::now();
+	g.root.reset();
+	g.signals.clear();
+	double teardown_ms = elapsed_ms(teardown_start);
+
+	std::printf("{\n");
+	std::printf("\t\"config\": {\"sources\": %zu, \"nodes\": %zu, \"depth\": %zu, \"fanin\": %zu, \"dynamic\": %g, \"writes\": %zu, \"seed\": %u, \"bulk\": %s},\n",
+		cfg.sources, cfg.nodes, cfg.depth, cfg.fanin, cfg.dynamic, cfg.writes, cfg.seed, cfg.bulk ? "true" : "false");
+	std::printf("\t\"graph\": {\"live_nodes\": %zu, \"edges\": %zu, \"dynamic_nodes\": %zu},\n",
+		live_nodes, edges, g.dynamic_nodes);
+	std::printf("\t\"build_ms\": %.3f,\n", build_ms);
+	std::printf("\t\"build_updates\": %llu,\n", static_cast<unsigned long long>(build_updates));
+	std::printf("\t\"latency_us\": {\"p50\": %.3f, \"p99\": %.3f, \"p999\": %.3f, \"max\": %.3f},\n",
+		percentile(latencies, 0.5), percentile(latencies, 0.99), percentile(latencies, 0.999),
+		latencies.empty() ? 0.0 : latencies.back());
+	std::printf("\t\"updates_per_write\": %.3f,\n", updates_per_write);
+	std::printf("\t\"ticks_per_write\": %.3f,\n", ticks_per_write);
+	std::printf("\t\"peak_rss_kb\": %ld,\n", rss_kb);
+	std::printf("\t\"teardown_ms\": %.3f\n", teardown_ms);
+	std::printf("}\n");
+
+	return 0;
+}
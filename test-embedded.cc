@@ -0,0 +1,283 @@
+#define LIBSIG_MAIN
+#define LIBSIG_RUNAWAYTHRESH 200
+#define LIBSIG_NO_EXCEPTIONS
+#define LIBSIG_HEAP_FREE_AFTER_BUILD
+#include <sig.hh>
+
+#include "./test.inc"
+
+#include <cstdlib>
+#include <new>
+
+using namespace libsig;
+using namespace std;
+
+/* aborts on any allocation while set */
+static bool allocations_forbidden = false;
+
+/*
+	Kept out of line, so the compiler can't pair a new-expression with
+	the free() below and flag it as a mismatched deallocation.
+*/
+#if defined(__GNUC__)
+#	define NOINLINE __attribute__((noinline))
+#else
+#	define NOINLINE
+#endif
+
+NOINLINE void * operator new(std::size_t n) {
+	if (allocations_forbidden) {
+		allocations_forbidden = false;
+		std::abort();
+	}
+	if (void *p = std::malloc(n ? n : 1)) return p;
+	std::abort();
+}
+
+NOINLINE void operator delete(void *p) noexcept {
+	std::free(p);
+}
+
+NOINLINE void operator delete(void *p, std::size_t) noexcept {
+	std::free(p);
+}
+
+static vector<sig_error> errors;
+
+static void record_error(sig_error code, const char *) {
+	errors.push_back(code);
+}
+
+BEFORE_ALL() {
+	libsig::detail::system = libsig::detail::system_state();
+	errors.clear();
+	errors.reserve(16);
+	set_error_handler(&record_error);
+}
+
+TEST(steady_state_is_heap_free) {
+	sig<int> a(1), b(2), sum, twice;
+	sig_buffer<int> buf(8);
+	int runs = 0;
+
+	sig_root root([=, &runs]() mutable {
+		S([=, &runs]() mutable { sum = a + b; ++runs; });
+		S([=]() mutable { twice = sum * 2 + buf[3]; });
+	});
+
+	CHECK(twice == 6);
+	CHECK(runs == 1);
+
+	allocations_forbidden = true;
+	for (int i = 0; i < 100; i++) {
+		a = i;
+	}
+	S.freeze([=]() mutable {
+		a = 10;
+		b = 20;
+	});
+	buf.set(3, 4);
+	allocations_forbidden = false;
+
+	CHECK(sum == 30);
+	CHECK(twice == 64);
+	CHECK(runs == 102);
+	CHECK(errors.empty());
+}
+
+struct point {
+	int x;
+	int y;
+};
+
+TEST(steady_state_of_other_nodes_is_heap_free) {
+	sig<int> key, a;
+	sig_store<point> p(point{1, 2});
+	vector<sig<int>> parts(4);
+	int selected = 0, x_runs = 0, effect_runs = 0, seen = 0;
+
+	sig_root root([=, &selected, &x_runs, &effect_runs, &seen]() mutable {
+		auto is_selected = S.selector(key);
+		for (int k = 0; k < 4; k++) {
+			S([=, &selected]() mutable { if (is_selected.is(k)) selected = k; });
+		}
+
+		auto x = p.at(&point::x);
+		S([=, &x_runs]() mutable { int v = x; (void) v; ++x_runs; });
+
+		auto total = S.sum(parts);
+		S.effect([=, &effect_runs, &seen]() mutable { seen = total + a; ++effect_runs; });
+	});
+
+	CHECK(selected == 0);
+	CHECK(x_runs == 1);
+	CHECK(effect_runs == 1);
+
+	allocations_forbidden = true;
+	for (int i = 1; i < 4; i++) {
+		key = i;
+	}
+	p.update([](point &pt) { pt.y = 3; });
+	p.at(&point::x) = 5;
+	S.freeze([&]() {
+		parts[1] = 10;
+		parts[2] = 20;
+		a = 1;
+	});
+	allocations_forbidden = false;
+
+	CHECK(selected == 3);
+	CHECK(x_runs == 2);
+	CHECK(effect_runs == 2);
+	CHECK(seen == 31);
+	CHECK(errors.empty());
+}
+
+TEST(rereading_an_unchanged_input_stays_in_capacity) {
+	sig<int> a(1), b(2);
+	int first = 0, second = 0;
+
+	sig_root root([=, &first, &second]() mutable {
+		S([=, &first]() mutable { first = a + b; });
+		S([=, &second]() mutable { second = a + b; });
+	});
+
+	/* each run re-reads `a`, which never changes */
+	for (int i = 0; i < 100; i++) {
+		b = i;
+	}
+
+	CHECK(errors.empty());
+	CHECK(first == 100);
+	CHECK(second == 100);
+
+	a = 10;
+	CHECK(first == 109);
+	CHECK(second == 109);
+}
+
+TEST(rereading_other_nodes_is_heap_free) {
+	sig<int> key, tick;
+	sig_store<point> p(point{1, 2});
+	vector<sig<int>> parts(4);
+	int selected = -1, x = 0, total = 0;
+
+	sig_root root([=, &selected, &x, &total]() mutable {
+		auto is_selected = S.selector(key);
+		auto px = p.at(&point::x);
+		auto sum = S.sum(parts);
+
+		/* each re-reads a node that doesn't change whenever `tick` does */
+		for (int k = 0; k < 2; k++) {
+			S([=, &selected]() mutable { if (is_selected.is(k) && tick >= 0) selected = k; });
+			S([=, &x]() mutable { x = px + tick; });
+			S([=, &total]() mutable { total = sum + tick; });
+		}
+	});
+
+	allocations_forbidden = true;
+	for (int i = 0; i < 100; i++) {
+		tick = i;
+	}
+	key = 1;
+	p.at(&point::x) = 5;
+	parts[2] = 10;
+	allocations_forbidden = false;
+
+	CHECK(errors.empty());
+	CHECK(selected == 1);
+	CHECK(x == 104);
+	CHECK(total == 109);
+}
+
+TEST(conflicts_keep_first_value) {
+	sig<int> i;
+
+	S.freeze([=]() mutable {
+		i = 10;
+		i = 10; /* OK */
+		i = 40;
+	});
+
+	ASSERT(errors.size() == 1);
+	CHECK(errors[0] == detail::error_conflict);
+	CHECK(i == 10);
+}
+
+TEST(runaway_clock_is_reported) {
+	sig<int> i, j;
+	sig_root root([=]() mutable {
+		S([=]() mutable { i = j; });
+		S([=]() mutable { j = i; });
+	});
+
+	ASSERT(errors.size() == 1);
+	CHECK(errors[0] == detail::error_runaway);
+}
+
+TEST(observer_capacity_is_reported) {
+	sig<int> s;
+	int runs = 0;
+
+	/* two roots, so neither runs out of room for children */
+	auto readers = [=, &runs](int count) mutable {
+		for (int i = 0; i < count; i++) {
+			S([=, &runs]() mutable { int v = s; (void) v; ++runs; });
+		}
+	};
+	sig_root first([=]() mutable { readers(LIBSIG_MAXOBSERVERS / 2); });
+	sig_root second([=]() mutable { readers(LIBSIG_MAXOBSERVERS / 2 + 1); });
+
+	ASSERT(errors.size() == 1);
+	CHECK(errors[0] == detail::error_capacity);
+
+	/* the observer that didn't fit isn't notified */
+	runs = 0;
+	s = 1;
+	CHECK(runs == LIBSIG_MAXOBSERVERS);
+}
+
+TEST(child_capacity_is_reported) {
+	sig_root root([] {
+		for (int i = 0; i < LIBSIG_MAXROOTCHILDREN + 1; i++) {
+			S([] {});
+		}
+	});
+
+	ASSERT(errors.size() == 1);
+	CHECK(errors[0] == detail::error_capacity);
+
+	sig_root nested([] {
+		S([] {
+			for (int i = 0; i < LIBSIG_MAXCHILDREN + 1; i++) {
+				S([] {});
+			}
+		});
+	});
+
+	ASSERT(errors.size() == 2);
+	CHECK(errors[1] == detail::error_capacity);
+}
+
+TEST(out_of_range_buffer_access_is_reported) {
+	sig_buffer<int> buf(4);
+
+	buf.set(4, 1);
+	ASSERT(errors.size() == 1);
+	CHECK(errors[0] == detail::error_out_of_range);
+	CHECK(buf.changed_count() == 0);
+
+	buf.set(3, 7);
+	CHECK(buf.at(10) == 0);
+	ASSERT(errors.size() == 2);
+	CHECK(errors[1] == detail::error_out_of_range);
+}
+
+TEST(computation_outside_root_is_reported) {
+	int runs = 0;
+	S([&runs] { ++runs; });
+
+	ASSERT(errors.size() == 1);
+	CHECK(errors[0] == detail::error_no_owner);
+	CHECK(runs == 0);
+}
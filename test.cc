@@ -1,10 +1,20 @@
 #define LIBSIG_MAIN
 #define LIBSIG_RUNAWAYTHRESH 200
+#define LIBSIG_ALLOC_STATS
+#ifndef _WIN32
+#	define LIBSIG_SHM
+#endif
+#ifdef __linux__
+#	define LIBSIG_EVENTFD
+#endif
 #include <sig.hh>
 
 #include "./test.inc"
 
 #include <sstream>
+#include <thread>
+#include <atomic>
+#include <cmath>
 
 using namespace libsig;
 using namespace std;
@@ -742,3 +752,2026 @@ TEST(destructor_called_on_refresh) {
 	foo = 15;
 	ASSERT(dcount == 3);
 }
+
+TEST(registry_snapshot_roundtrip) {
+	val<int> a(10);
+	sig<string> b("hello");
+	val<double> c(2.5);
+
+	sig_registry reg;
+	reg.add("a", a);
+	reg.add("b", b);
+	reg.add("c", c);
+	ASSERT(reg.size() == 3);
+
+	stringstream ss;
+	reg.save(ss);
+
+	val<int> a2;
+	sig<string> b2;
+	val<double> c2;
+	int invocations = 0;
+
+	sig_root root([=, &invocations]() mutable {
+		S([=, &invocations]() mutable {
+			a2.depend();
+			b2.depend();
+			c2.depend();
+			++invocations;
+		});
+	});
+
+	CHECK(invocations == 1);
+
+	sig_registry reg2;
+	reg2.add("c", c2);
+	reg2.add("a", a2);
+	reg2.add("b", b2);
+	reg2.load(ss);
+
+	CHECK(a2 == 10);
+	CHECK(b2 == "hello");
+	CHECK(c2 == 2.5);
+	CHECK(invocations == 2);
+}
+
+TEST(registry_snapshot_partial) {
+	val<int> a(1), b(2);
+
+	sig_registry reg;
+	reg.add("a", a);
+	reg.add("b", b);
+	string snap = reg.save();
+
+	val<int> b2(0), z(99);
+	sig_registry reg2;
+	reg2.add("b", b2);
+	reg2.add("z", z);
+	reg2.load(snap.data(), snap.size());
+
+	CHECK(b2 == 2);
+	CHECK(z == 99);
+}
+
+TEST(registry_snapshot_errors) {
+	val<int> a(1);
+	sig_registry reg;
+	reg.add("a", a);
+
+	bool dup = false;
+	try {
+		reg.add("a", a);
+	} catch (const std::logic_error &ex) {
+		CHECK(string(ex.what()) == "duplicate registry key");
+		dup = true;
+	}
+	CHECK(dup);
+
+	string snap = reg.save();
+	bool truncated = false;
+	try {
+		reg.load(snap.data(), snap.size() - 4);
+	} catch (const std::runtime_error &ex) {
+		CHECK(string(ex.what()) == "malformed snapshot");
+		truncated = true;
+	}
+	CHECK(truncated);
+	CHECK(a == 1);
+
+	/* a value size that would wrap when padded */
+	string huge = snap;
+	std::uint64_t size = ~static_cast<std::uint64_t>(0) - 3;
+	std::memcpy(&huge[24], &size, sizeof(size));
+	bool wrapped = false;
+	try {
+		reg.load(huge.data(), huge.size());
+	} catch (const std::runtime_error &ex) {
+		CHECK(string(ex.what()) == "malformed snapshot");
+		wrapped = true;
+	}
+	CHECK(wrapped);
+	CHECK(a == 1);
+
+	/* an entry count the data can't hold, and a header cut short */
+	string oversized = snap;
+	std::uint32_t count = ~static_cast<std::uint32_t>(0);
+	std::memcpy(&oversized[12], &count, sizeof(count));
+	for (std::size_t size : {oversized.size(), static_cast<std::size_t>(14)}) {
+		bool thrown = false;
+		try {
+			reg.load(oversized.data(), size);
+		} catch (const std::runtime_error &ex) {
+			CHECK(string(ex.what()) == "malformed snapshot");
+			thrown = true;
+		}
+		CHECK(thrown);
+	}
+	CHECK(a == 1);
+}
+
+TEST(registry_snapshot_is_validated_before_loading) {
+	val<int> a(1);
+	sig<string> b("x");
+	val<double> c(2.5);
+
+	sig_registry reg;
+	reg.add("a", a);
+	reg.add("b", b);
+	reg.add("c", c);
+	string snap = reg.save();
+
+	/* the same keys, but "c" can't hold a double */
+	val<int> a2(0);
+	sig<string> b2;
+	val<int> c2(0);
+	int invocations = 0;
+
+	sig_registry reg2;
+	reg2.add("a", a2);
+	reg2.add("b", b2);
+	reg2.add("c", c2);
+
+	sig_root root([=, &invocations]() mutable {
+		S([=, &invocations]() mutable {
+			a2.depend();
+			b2.depend();
+			++invocations;
+		});
+	});
+
+	bool thrown = false;
+	try {
+		reg2.load(snap.data(), snap.size());
+	} catch (const std::runtime_error &ex) {
+		CHECK(string(ex.what()) == "malformed snapshot value for key: c");
+		thrown = true;
+	}
+
+	CHECK(thrown);
+	CHECK(a2 == 0);
+	CHECK(b2 == "");
+	CHECK(invocations == 1);
+}
+
+TEST(recorder_replay) {
+	string log;
+
+	{
+		val<int> a;
+		sig<string> b;
+		sig<int> internal, unregistered;
+
+		sig_registry reg;
+		reg.add("a", a);
+		reg.add("b", b);
+		reg.add("internal", internal);
+
+		sig_root root([=]() mutable {
+			S([=]() mutable { internal = a * 2; });
+		});
+
+		stringstream ss;
+		{
+			sig_recorder rec(reg, ss);
+			a = 1;
+			S.freeze([=]() mutable {
+				a = 2;
+				b = "frozen";
+			});
+			unregistered = 5;
+			b = "after";
+
+			/* 1 write, freeze, 2 writes, thaw, 1 write */
+			CHECK(rec.recorded() == 6);
+			CHECK(rec.unrecorded() == 1);
+		}
+
+		a = 100; /* not recorded */
+		log = ss.str();
+	}
+
+	val<int> a;
+	sig<string> b;
+	sig<int> internal;
+	vector<string> seen;
+
+	sig_registry reg;
+	reg.add("b", b);
+	reg.add("a", a);
+	reg.add("internal", internal);
+
+	sig_root root([=, &seen]() mutable {
+		S([=]() mutable { internal = a * 2; });
+		S([=, &seen]() mutable {
+			seen.push_back(to_string(a) + ":" + b.operator string&());
+		});
+	});
+
+	CHECK(seen.size() == 1);
+
+	sig_replayer rp(reg);
+	CHECK(rp.replay(log.data(), log.size()) == 6);
+
+	CHECK(a == 2);
+	CHECK(b == "after");
+	CHECK(internal == 4);
+	ASSERT(seen.size() == 4);
+	CHECK(seen[1] == "1:");
+	CHECK(seen[2] == "2:frozen");
+	CHECK(seen[3] == "2:after");
+}
+
+TEST(replayer_rejects_malformed_headers) {
+	val<int> a;
+	sig_registry reg;
+	reg.add("a", a);
+
+	stringstream ss;
+	{
+		sig_recorder rec(reg, ss);
+		a = 1;
+	}
+	string log = ss.str();
+
+	/* a key count the data can't hold, and a header cut short */
+	string oversized = log;
+	std::uint32_t count = ~static_cast<std::uint32_t>(0);
+	std::memcpy(&oversized[12], &count, sizeof(count));
+	for (std::size_t size : {oversized.size(), static_cast<std::size_t>(14)}) {
+		bool thrown = false;
+		try {
+			sig_replayer rp(reg);
+			rp.replay(oversized.data(), size);
+		} catch (const std::runtime_error &ex) {
+			CHECK(string(ex.what()) == "malformed write log");
+			thrown = true;
+		}
+		CHECK(thrown);
+	}
+	CHECK(a == 1);
+}
+
+TEST(replayed_errors_propagate_from_replay) {
+	val<int> a, b;
+	sig_registry reg;
+	reg.add("a", a);
+	reg.add("b", b);
+
+	stringstream log;
+	{
+		sig_recorder rec(reg, log);
+		S.freeze([=]() mutable {
+			S.freeze([=]() mutable { a = 1; });
+			b = 2;
+		});
+	}
+
+	val<int> a2, b2;
+	sig_registry other;
+	other.add("a", a2);
+	other.add("b", b2);
+	int runs = 0;
+
+	sig_root root([=, &runs]() mutable {
+		S([=, &runs]() mutable {
+			++runs;
+			if (a2 + b2 == 3) throw std::runtime_error("bad value");
+		});
+	});
+
+	bool thrown = false;
+	try {
+		sig_replayer rp(other);
+		string data = log.str();
+		rp.replay(data.data(), data.size());
+	} catch (const std::runtime_error &ex) {
+		CHECK(string(ex.what()) == "bad value");
+		thrown = true;
+	}
+
+	CHECK(thrown);
+	CHECK(a2 == 1);
+	CHECK(b2 == 2);
+	CHECK(runs == 2);
+}
+
+TEST(recorder_skips_writes_made_by_the_graph) {
+	/* a listener and a settled callback each derive a signal from `a` */
+	struct graph {
+		sig_registry reg;
+		shared_ptr<sig<int>> a;
+		shared_ptr<val<int>> doubled, tripled;
+		int runs;
+		subscription sub, settled;
+		unique_ptr<sig_root> root;
+
+		graph()
+		: runs(0)
+		{
+			root.reset(new sig_root([this] {
+				a = make_shared<sig<int>>();
+				doubled = make_shared<val<int>>();
+				tripled = make_shared<val<int>>();
+				reg.add("a", *a);
+				reg.add("doubled", *doubled);
+				reg.add("tripled", *tripled);
+
+				sig<int> sa(*a);
+				val<int> d(*doubled), t(*tripled);
+				S([this, d, t]() mutable {
+					(void) (d + t);
+					++runs;
+				});
+
+				sub = sa.subscribe([d](const int &, const int &v) mutable { d = v * 2; });
+				settled = S.on_settled([sa, t]() mutable { t = sa * 3; });
+			}));
+		}
+	};
+
+	graph live;
+	stringstream log;
+	{
+		sig_recorder rec(live.reg, log);
+		*live.a = 1;
+		*live.a = 2;
+		CHECK(rec.recorded() == 2);
+	}
+
+	graph replayed;
+	sig_replayer rp(replayed.reg);
+	string data = log.str();
+	CHECK(rp.replay(data.data(), data.size()) == 2);
+
+	CHECK(*replayed.doubled == 4);
+	CHECK(*replayed.tripled == 6);
+	CHECK(replayed.runs == live.runs);
+}
+
+TEST(recorder_sees_writes_to_root_signals) {
+	sig_registry reg;
+	shared_ptr<sig<int>> inner;
+
+	sig_root root([&reg, &inner] {
+		inner = make_shared<sig<int>>();
+		reg.add("inner", *inner);
+	});
+
+	stringstream ss;
+	sig_recorder rec(reg, ss);
+
+	/* batches on the root's clock */
+	*inner = 1;
+	CHECK(rec.recorded() == 1);
+
+	/* batches on the thread's clock */
+	sig<int> s(*inner);
+	S.freeze([=]() mutable { s = 2; });
+	CHECK(rec.recorded() == 4);
+	CHECK(*inner == 2);
+}
+
+TEST(recorder_replay_of_root_signals) {
+	/* builds a root owning registered signals, and a computation summing them */
+	struct graph {
+		sig_registry reg;
+		shared_ptr<sig<int>> a, b;
+		int sum;
+		vector<int> seen;
+		unique_ptr<sig_root> root;
+
+		graph()
+		: sum(0)
+		{
+			root.reset(new sig_root([this] {
+				a = make_shared<sig<int>>();
+				b = make_shared<sig<int>>();
+				reg.add("a", *a);
+				reg.add("b", *b);
+
+				sig<int> sa(*a), sb(*b);
+				S([this, sa, sb]() mutable {
+					sum = sa + sb;
+					seen.push_back(sum);
+				});
+			}));
+		}
+	};
+
+	graph first;
+	stringstream log;
+	{
+		sig_recorder rec(first.reg, log);
+		*first.a = 1;
+		sig<int> sa(*first.a), sb(*first.b);
+		S.freeze([=]() mutable {
+			sa = 2;
+			sb = 3;
+		});
+		*first.b = 4;
+		CHECK(rec.recorded() == 6);
+	}
+
+	graph second;
+	stringstream relog;
+	{
+		sig_recorder rec(second.reg, relog);
+		sig_replayer rp(second.reg);
+		string data = log.str();
+		CHECK(rp.replay(data.data(), data.size()) == 6);
+		CHECK(rec.recorded() == 6);
+	}
+
+	CHECK(second.sum == 6);
+	CHECK(second.seen == first.seen);
+	CHECK(relog.str() == log.str());
+}
+
+TEST(derived_expression) {
+	val<int> price(3), qty(4);
+	int invocations = 0;
+	int seen = 0;
+
+	auto total = S.derive(expr(price) * qty);
+	CHECK(total == 12);
+
+	auto with_tax = S.derive(expr(total) + 1);
+	CHECK(with_tax == 13);
+
+	sig_root root([=, &invocations, &seen]() mutable {
+		S([=, &invocations, &seen]() mutable {
+			seen = with_tax;
+			++invocations;
+		});
+	});
+
+	CHECK(invocations == 1);
+	CHECK(seen == 13);
+
+	price = 5;
+	CHECK(total == 20);
+	CHECK(with_tax == 21);
+	CHECK(seen == 21);
+	CHECK(invocations == 2);
+
+	S.freeze([=]() mutable {
+		price = 4;
+		qty = 5;
+	});
+	CHECK(total == 20);
+	CHECK(invocations == 2); /* result unchanged */
+
+	qty = 1;
+	CHECK(total == 4);
+	CHECK(seen == 5);
+	CHECK(invocations == 3);
+}
+
+TEST(derived_expression_mixed_operands) {
+	sig<int> a(2), b(10);
+	auto e = S.derive(100 - expr(a) * b);
+	CHECK(e == 80);
+
+	auto is_big = S.derive(expr(a) == 7);
+	CHECK(is_big == false);
+
+	a = 7;
+	CHECK(e == 30);
+	CHECK(is_big == true);
+}
+
+TEST(signal_buffer_bulk) {
+	sig_buffer<float> buf(200);
+	int whole = 0;
+	int elem_3 = 0;
+	int elem_150 = 0;
+
+	sig_root root([=, &whole, &elem_3, &elem_150]() mutable {
+		S([=, &whole]() mutable { buf.depend(); ++whole; });
+		S([=, &elem_3]() mutable { (void) buf.at(3); ++elem_3; });
+		S([=, &elem_150]() mutable { (void) buf[150]; ++elem_150; });
+	});
+
+	CHECK(whole == 1);
+	CHECK(elem_3 == 1);
+	CHECK(elem_150 == 1);
+
+	vector<float> values(200, 0.0f);
+	values[3] = 1.0f;
+	values[64] = 2.0f;
+	buf.assign(values);
+
+	CHECK(buf.sample(3) == 1.0f);
+	CHECK(buf.sample(64) == 2.0f);
+	CHECK(buf.changed_count() == 2);
+	CHECK(buf.changed(3));
+	CHECK(buf.changed(64));
+	CHECK(!buf.changed(150));
+	CHECK(buf.changed_bits()[1] == 1);
+	CHECK(whole == 2);
+	CHECK(elem_3 == 2);
+	CHECK(elem_150 == 1);
+
+	/* identical write; nothing changes */
+	buf.assign(values);
+	CHECK(buf.changed_count() == 0);
+	CHECK(whole == 2);
+	CHECK(elem_3 == 2);
+
+	S.freeze([=]() mutable {
+		buf.set(150, 5.0f);
+		buf.set(150, 6.0f);
+		buf.modify([](float *v, size_t n) {
+			for (size_t i = 100; i < n; i++) v[i] += 1.0f;
+		});
+		CHECK(buf.sample(150) == 0.0f);
+	});
+
+	CHECK(buf.sample(150) == 7.0f);
+	CHECK(buf.sample(199) == 1.0f);
+	CHECK(buf.sample(3) == 1.0f);
+	CHECK(buf.changed_count() == 100);
+	CHECK(whole == 3);
+	CHECK(elem_3 == 2);
+	CHECK(elem_150 == 2);
+}
+
+TEST(signal_array_basic) {
+	sig_array<int, 4> arr(7);
+	static_assert(sig_array<int, 4>::size() == 4, "size is static");
+	CHECK(arr.sample(2) == 7);
+
+	int sum = 0;
+	sig_root root([=, &sum]() mutable {
+		S([=, &sum]() mutable {
+			const int *v = arr.values();
+			sum = v[0] + v[1] + v[2] + v[3];
+		});
+	});
+
+	CHECK(sum == 28);
+	int values[] = {1, 2};
+	arr.assign(values, 2, 2);
+	CHECK(sum == 17);
+
+	bool thrown = false;
+	try {
+		arr.set(4, 0);
+	} catch (const std::out_of_range &) {
+		thrown = true;
+	}
+	CHECK(thrown);
+}
+
+TEST(selector_basic) {
+	val<int> selected(3);
+	auto is_selected = S.selector(selected);
+	vector<int> runs(100, 0);
+	vector<bool> state(100, false);
+
+	CHECK(is_selected.sample() == 3);
+
+	sig_root root([=, &runs, &state]() mutable {
+		for (int i = 0; i < 100; i++) {
+			S([=, &runs, &state]() mutable {
+				state[i] = is_selected.is(i);
+				++runs[i];
+			});
+		}
+	});
+
+	int total = 0;
+	for (int r : runs) total += r;
+	CHECK(total == 100);
+	CHECK(state[3]);
+
+	selected = 7;
+	total = 0;
+	for (int r : runs) total += r;
+	CHECK(total == 102);
+	CHECK(runs[3] == 2);
+	CHECK(runs[7] == 2);
+	CHECK(!state[3]);
+	CHECK(state[7]);
+
+	selected = 7;
+	total = 0;
+	for (int r : runs) total += r;
+	CHECK(total == 102);
+
+	selected = 3;
+	CHECK(runs[3] == 3);
+	CHECK(runs[7] == 3);
+	CHECK(runs[50] == 1);
+	CHECK(state[3]);
+	CHECK(!state[7]);
+}
+
+struct test_net {
+	int port;
+	int retries;
+};
+
+struct test_config {
+	int timeout;
+	string name;
+	test_net net;
+};
+
+TEST(store_field_tracking) {
+	sig_store<test_config> cfg(test_config{30, "svc", {80, 3}});
+	auto timeout = cfg.at(&test_config::timeout);
+	auto name = cfg.at(&test_config::name);
+	auto port = cfg.at(&test_config::net, &test_net::port);
+
+	int timeout_runs = 0, name_runs = 0, port_runs = 0, whole_runs = 0;
+	int seen_timeout = 0, seen_port = 0;
+
+	sig_root root([=, &timeout_runs, &name_runs, &port_runs, &whole_runs, &seen_timeout, &seen_port]() mutable {
+		S([=, &timeout_runs, &seen_timeout]() mutable { seen_timeout = timeout; ++timeout_runs; });
+		S([=, &name_runs]() mutable { name.depend(); ++name_runs; });
+		S([=, &port_runs, &seen_port]() mutable { seen_port = port; ++port_runs; });
+		S([=, &whole_runs]() mutable { cfg.depend(); ++whole_runs; });
+	});
+
+	CHECK(seen_timeout == 30);
+	CHECK(seen_port == 80);
+
+	timeout = 60;
+	CHECK(timeout.sample() == 60);
+	CHECK(cfg.sample().timeout == 60);
+	CHECK(seen_timeout == 60);
+	CHECK(timeout_runs == 2);
+	CHECK(name_runs == 1);
+	CHECK(port_runs == 1);
+	CHECK(whole_runs == 2);
+
+	/* unchanged field */
+	timeout = 60;
+	CHECK(timeout_runs == 2);
+	CHECK(whole_runs == 3);
+
+	cfg.update([](test_config &c) {
+		c.name = "other";
+		c.net.port = 8080;
+		c.net.retries = 5;
+	});
+
+	CHECK(cfg.sample().net.retries == 5);
+	CHECK(seen_port == 8080);
+	CHECK(timeout_runs == 2);
+	CHECK(name_runs == 2);
+	CHECK(port_runs == 2);
+	CHECK(whole_runs == 4);
+
+	S.freeze([=]() mutable {
+		timeout = 1;
+		port = 1;
+		CHECK(timeout.sample() == 60);
+	});
+
+	CHECK(seen_timeout == 1);
+	CHECK(seen_port == 1);
+	CHECK(timeout_runs == 3);
+	CHECK(port_runs == 3);
+	CHECK(name_runs == 2);
+	CHECK(whole_runs == 5);
+}
+
+struct test_graph {
+	unique_ptr<sig<int>> in, out;
+	unique_ptr<sig_root> root;
+	int runs = 0;
+
+	test_graph() {
+		root.reset(new sig_root([this] {
+			in.reset(new sig<int>());
+			out.reset(new sig<int>());
+			sig<int> i(*in), o(*out);
+			int *r = &runs;
+			S([=]() mutable { o = i * 2; ++*r; });
+		}));
+	}
+};
+
+TEST(root_clocks_are_independent) {
+	test_graph a, b;
+
+	auto a_time = a.root->get_clock().time();
+	auto b_time = b.root->get_clock().time();
+
+	*a.in = 5;
+	CHECK(*a.out == 10);
+	CHECK(a.runs == 2);
+	CHECK(b.runs == 1);
+	CHECK(a.root->get_clock().time() > a_time);
+	CHECK(b.root->get_clock().time() == b_time);
+
+	*b.in = 7;
+	CHECK(*b.out == 14);
+	CHECK(*a.out == 10);
+}
+
+TEST(root_migrates_between_threads) {
+	test_graph a, b;
+
+	thread ta([&a] {
+		for (int i = 1; i <= 1000; i++) *a.in = i;
+	});
+
+	thread tb([&b] {
+		for (int i = 1; i <= 1000; i++) *b.in = -i;
+	});
+
+	ta.join();
+	tb.join();
+
+	CHECK(*a.out == 2000);
+	CHECK(*b.out == -2000);
+	CHECK(a.runs == 1001);
+	CHECK(b.runs == 1001);
+
+	/* and back on this thread */
+	*a.in = 1;
+	CHECK(*a.out == 2);
+}
+
+struct test_pair {
+	int a, b;
+
+	bool operator !=(const test_pair &other) const
+		{ return a != other.a || b != other.b; }
+};
+
+TEST(published_reads_from_other_threads) {
+	val<test_pair> pair(test_pair{0, 0});
+	sig<string> label("start");
+
+	auto pub_pair = S.publish(pair);
+	auto pub_label = S.publish(label);
+
+	CHECK(pub_pair.load().a == 0);
+	CHECK(*pub_label.load_shared() == "start");
+
+	atomic<bool> done(false);
+	atomic<int> torn(0);
+	atomic<int> reads(0);
+
+	thread reader([=, &done, &torn, &reads] {
+		while (!done.load()) {
+			test_pair p = pub_pair.load();
+			if (p.b != p.a * 2) ++torn;
+			if (pub_label.load().empty()) ++torn;
+			++reads;
+		}
+	});
+
+	for (int i = 1; i <= 20000; i++) {
+		pair = test_pair{i, i * 2};
+		if (i % 1000 == 0) label = to_string(i);
+	}
+
+	while (reads.load() < 100) this_thread::yield();
+	done = true;
+	reader.join();
+
+	CHECK(torn == 0);
+	CHECK(pub_pair.load().a == 20000);
+	CHECK(pub_pair.version() == 20000);
+	CHECK(pub_label.load() == "20000");
+	CHECK(pub_label.version() == 20);
+}
+
+#ifdef LIBSIG_SHM
+#include <unistd.h>
+
+struct test_pos {
+	float x, y;
+
+	bool operator !=(const test_pos &other) const
+		{ return x != other.x || y != other.y; }
+};
+
+TEST(shm_signal_fanout) {
+	string prefix = "/libsig-test-" + to_string(getpid());
+	shm_val<int> count(prefix + "-count", 1);
+	shm_val<test_pos> pos(prefix + "-pos", test_pos{1.0f, 2.0f});
+
+	val<int> r_count;
+	sig<test_pos> r_pos;
+	shm_consumer consumer;
+	consumer.open(prefix + "-count", r_count);
+	consumer.open(prefix + "-pos", r_pos);
+
+	CHECK(r_count == 1);
+	CHECK(r_pos.sample().y == 2.0f);
+
+	int runs = 0;
+	sig_root root([=, &runs]() mutable {
+		S([=, &runs]() mutable {
+			r_count.depend();
+			r_pos.depend();
+			++runs;
+		});
+	});
+
+	CHECK(runs == 1);
+	CHECK(consumer.poll() == 0);
+	CHECK(runs == 1);
+
+	count = 2;
+	pos = test_pos{3.0f, 4.0f};
+	CHECK(count.version() == 2);
+	CHECK(r_count == 1); /* not polled yet */
+
+	CHECK(consumer.poll() == 2);
+	CHECK(r_count == 2);
+	CHECK(r_pos.sample().x == 3.0f);
+	CHECK(runs == 2);
+
+	count = 2; /* unchanged; not published */
+	CHECK(count.version() == 2);
+	CHECK(consumer.poll() == 0);
+
+	bool thrown = false;
+	try {
+		consumer.open(prefix + "-missing", r_count);
+	} catch (const std::system_error &) {
+		thrown = true;
+	}
+	CHECK(thrown);
+}
+#endif
+
+TEST(signal_policies) {
+	sig<int, sig_policy<false>> untracked(1);
+	sig<int, sig_policy<true, true, false>> last_wins(0);
+	val<int, sig_policy<true, false>> unowned(0);
+	int runs = 0;
+	int seen = 0;
+
+	sig_root root([=, &runs, &seen]() mutable {
+		S([=, &runs, &seen]() mutable {
+			seen = untracked + unowned;
+			++runs;
+		});
+	});
+
+	CHECK(seen == 1);
+	untracked = 5;
+	CHECK(runs == 1);
+
+	unowned = 2;
+	CHECK(runs == 2);
+	CHECK(seen == 7);
+
+	S.freeze([=]() mutable {
+		last_wins = 1;
+		last_wins = 2;
+	});
+	CHECK(last_wins == 2);
+
+	sig<int> mixed(3);
+	mixed = untracked;
+	CHECK(mixed == 5);
+}
+
+TEST(last_write_restoring_a_value_is_dropped) {
+	val<int, sig_policy<true, true, false>> v(1);
+	int runs = 0;
+	int commits = 0;
+
+	sig_root root([=, &runs]() mutable {
+		S([=, &runs]() mutable {
+			v.depend();
+			++runs;
+		});
+	});
+	auto sub = v.subscribe([&commits](const int &, const int &) { ++commits; });
+
+	S.freeze([=]() mutable {
+		v = 2;
+		v = 1;
+	});
+	CHECK(v == 1);
+	CHECK(runs == 1);
+	CHECK(commits == 0);
+
+	S.freeze([=]() mutable {
+		v = 2;
+		v = 3;
+	});
+	CHECK(v == 3);
+	CHECK(runs == 2);
+	CHECK(commits == 1);
+}
+
+TEST(throwing_listener_doesnt_hold_back_propagation) {
+	sig<int> a(1), out;
+	int later = 0;
+
+	sig_root root([=]() mutable {
+		S([=]() mutable { out = a * 2; });
+	});
+	auto failing = a.subscribe([](const int &, const int &) { throw std::runtime_error("listener failed"); });
+	auto counting = a.subscribe([&later](const int &, const int &) { ++later; });
+
+	bool thrown = false;
+	try {
+		a = 2;
+	} catch (const std::runtime_error &ex) {
+		CHECK(string(ex.what()) == "listener failed");
+		thrown = true;
+	}
+
+	CHECK(thrown);
+	CHECK(a == 2);
+	CHECK(out == 4);
+	CHECK(later == 1);
+}
+
+TEST(signal_subscribe) {
+	val<int> v(1);
+	sig<string> s("a");
+	vector<pair<int, int>> changes;
+	string last;
+
+	{
+		auto sub = v.subscribe([&changes](const int &old_value, const int &new_value) {
+			changes.push_back(make_pair(old_value, new_value));
+		});
+		auto watch = S.watch(s, [&last](const string &old_value, const string &new_value) {
+			last = old_value + "->" + new_value;
+		});
+		CHECK(bool(sub));
+
+		v = 2;
+		v = 2; /* unchanged */
+		v = 5;
+		s = "b";
+
+		ASSERT(changes.size() == 2);
+		CHECK(changes[0] == make_pair(1, 2));
+		CHECK(changes[1] == make_pair(2, 5));
+		CHECK(last == "a->b");
+
+		watch.reset();
+		CHECK(!watch);
+		s = "c";
+		CHECK(last == "a->b");
+	}
+
+	v = 6;
+	CHECK(changes.size() == 2);
+}
+
+TEST(dropped_subscriptions_are_removed) {
+	sig<int> rarely_written;
+
+	for (int i = 0; i < 1000; i++) {
+		auto sub = rarely_written.subscribe([](const int &, const int &) {});
+		CHECK(rarely_written.listener_count() == 1);
+	}
+	CHECK(rarely_written.listener_count() == 0);
+
+	/* dropped from within a notification */
+	subscription first, second;
+	int calls = 0;
+	first = rarely_written.subscribe([&](const int &, const int &) { ++calls; first.reset(); second.reset(); });
+	second = rarely_written.subscribe([&](const int &, const int &) { ++calls; });
+	rarely_written = 1;
+	CHECK(calls == 1);
+	CHECK(rarely_written.listener_count() == 0);
+
+	/* outliving the signal */
+	subscription orphan;
+	{
+		sig<int> gone;
+		orphan = gone.subscribe([](const int &, const int &) {});
+	}
+	orphan.reset();
+}
+
+TEST(signal_subscribe_in_batch) {
+	val<int> a;
+	sig<int> doubled;
+	int calls = 0;
+	int runs = 0;
+
+	auto sub = a.subscribe([=, &calls](const int &, const int &new_value) mutable {
+		++calls;
+		doubled = new_value * 2;
+	});
+
+	sig_root root([=, &runs]() mutable {
+		S([=, &runs]() mutable {
+			doubled.depend();
+			++runs;
+		});
+	});
+
+	S.freeze([=]() mutable {
+		a = 3;
+		CHECK(calls == 0);
+	});
+
+	CHECK(calls == 1);
+	CHECK(doubled == 6);
+	CHECK(runs == 2);
+}
+
+TEST(interleaved_owners_adopt_once) {
+	sig<int> s;
+	size_t children = 0;
+
+	sig_root root([=, &children]() mutable {
+		auto &owner = *libsig::detail::system.current_owner;
+		s.depend();
+
+		/* runs right away, adopting `s` in between */
+		S([=]() mutable { s.depend(); });
+
+		s.depend();
+		s.depend();
+		children = owner.children.size();
+	});
+
+	/* `s` and the computation */
+	CHECK(children == 2);
+}
+
+TEST(many_children_and_observers) {
+	sig<int> trigger(0);
+	vector<int> runs(10, 0);
+	int total = 0;
+
+	sig_root root([&]() mutable {
+		for (int i = 0; i < 10; i++) {
+			S([=, &runs]() mutable {
+				trigger.depend();
+				trigger.depend(); /* read twice, registered once */
+				++runs[i];
+			});
+		}
+
+		S([=, &total]() mutable {
+			/* owns more signals than fit inline */
+			vector<sig<int>> owned;
+			for (int i = 0; i < 10; i++) {
+				owned.emplace_back(i);
+			}
+
+			total = trigger;
+			for (auto &s : owned) {
+				total += s;
+			}
+		});
+	});
+
+	CHECK(total == 45);
+
+	trigger = 5;
+	CHECK(total == 50);
+	for (int r : runs) {
+		CHECK(r == 2);
+	}
+
+	trigger = 6;
+	CHECK(total == 51);
+	for (int r : runs) {
+		CHECK(r == 3);
+	}
+}
+
+TEST(map_keyed_reuses_children) {
+	typedef pair<int, string> item;
+	sig<vector<item>> list(vector<item>{{1, "a"}, {2, "b"}, {3, "c"}});
+	map<int, string> rendered;
+	int created = 0;
+	int disposed = 0;
+	int renders = 0;
+
+	sig_root root([=, &rendered, &created, &disposed, &renders]() mutable {
+		auto rows = S.map_keyed(list,
+			[](const item &i) { return i.first; },
+			[&rendered, &created, &disposed, &renders](val<item> &row) {
+				++created;
+				auto guard = make_shared<testdcns>(disposed);
+				S([=, &rendered, &renders]() mutable {
+					(void) guard;
+					const item &i = row;
+					rendered[i.first] = i.second;
+					++renders;
+				});
+			});
+		(void) rows;
+	});
+
+	CHECK(created == 3);
+	CHECK(renders == 3);
+	CHECK(rendered[2] == "b");
+
+	/* one item changes: only its row re-renders */
+	list = vector<item>{{1, "a"}, {2, "B"}, {3, "c"}};
+	CHECK(created == 3);
+	CHECK(disposed == 0);
+	CHECK(renders == 4);
+	CHECK(rendered[2] == "B");
+
+	/* reorder, drop one and add one: only the delta is created/disposed */
+	list = vector<item>{{4, "d"}, {3, "c"}, {1, "a"}};
+	CHECK(created == 4);
+	CHECK(disposed == 1);
+	CHECK(renders == 5);
+	CHECK(rendered[4] == "d");
+
+	list = vector<item>{};
+	CHECK(disposed == 4);
+}
+
+TEST(map_keyed_duplicate_keys) {
+	sig<vector<int>> list(vector<int>{1, 2});
+	bool threw = false;
+
+	sig_root root([=]() mutable {
+		S.map_keyed(list, [](const int &i) { return i; }, [](val<int> &) {});
+	});
+
+	try {
+		list = vector<int>{1, 1};
+	} catch (const std::logic_error &) {
+		threw = true;
+	}
+
+	CHECK(threw);
+}
+
+TEST(observer_lists_stay_compact) {
+	sig<int> config(1);
+	sig<int> trigger(0);
+	int reads = 0;
+
+	sig_root root([=, &reads]() mutable {
+		S([=, &reads]() mutable {
+			trigger.depend();
+
+			/* a fresh reader of `config` every run; the previous one is destroyed */
+			S([=, &reads]() mutable {
+				config.depend();
+				++reads;
+			});
+		});
+	});
+
+	for (int i = 1; i <= 1000; i++) {
+		trigger = i;
+	}
+
+	CHECK(reads == 1001);
+	CHECK(config.observer_count() <= 2 * LIBSIG_COMPACTTHRESH);
+
+	config = 2;
+	CHECK(reads == 1002);
+	CHECK(config.observer_count() == 1);
+}
+
+TEST(root_stats) {
+	test_graph g;
+	const sig_stats &st = g.root->stats();
+
+	CHECK(st.nodes[detail::node_signal] == 2);
+	CHECK(st.nodes[detail::node_computation] == 1);
+	CHECK(st.live_nodes() == 3);
+	CHECK(st.edges == 1);
+
+	auto ticks = st.ticks;
+	auto updates = st.updates;
+	*g.in = 5;
+	CHECK(st.ticks == ticks + 3);
+	CHECK(st.updates == updates + 3);
+	CHECK(st.edges == 1);
+
+	/* the signals still hold the clock */
+	g.root.reset();
+	CHECK(st.nodes[detail::node_computation] == 0);
+	CHECK(st.live_nodes() == 2);
+}
+
+TEST(allocations_are_attributed) {
+	sig<int> trigger;
+
+	sig_root root([=]() mutable {
+		S([=]() mutable {
+			trigger.depend();
+			S([] {});
+		});
+	});
+
+	auto allocations = S.stats().allocations;
+	trigger = 1;
+	CHECK(S.stats().allocations > allocations);
+
+	/* nothing running or frozen */
+	allocations = S.stats().allocations;
+	vector<int> unrelated(100);
+	CHECK(S.stats().allocations == allocations);
+}
+
+TEST(bulk_build_runs_each_computation_once) {
+	sig<int> a, b;
+	sig<int> sum, doubled;
+	int sum_runs = 0;
+	int doubled_runs = 0;
+
+	sig_root root([=, &sum_runs, &doubled_runs]() mutable {
+		S.build([=, &sum_runs, &doubled_runs]() mutable {
+			S([=, &sum_runs]() mutable {
+				sum = a + b;
+				++sum_runs;
+			});
+
+			S([=, &doubled_runs]() mutable {
+				doubled = sum * 2;
+				++doubled_runs;
+			});
+
+			/* written after wiring; nothing has run yet */
+			a = 1;
+			b = 2;
+			CHECK(sum_runs == 0);
+		});
+	});
+
+	CHECK(sum_runs == 1);
+	CHECK(doubled_runs == 1);
+	CHECK(doubled == 6);
+
+	a = 10;
+	CHECK(sum_runs == 2);
+	CHECK(doubled_runs == 2);
+	CHECK(doubled == 24);
+}
+
+TEST(timed_operators) {
+	using std::chrono::milliseconds;
+
+	manual_time now;
+	sig_timers timers(now);
+	val<int> input(0);
+
+	auto throttled = S.throttle(input, milliseconds(10), timers);
+	auto debounced = S.debounce(input, milliseconds(10), timers);
+	auto sampled = S.sample(input, milliseconds(10), timers);
+	int throttled_runs = 0;
+	int debounced_runs = 0;
+
+	sig_root root([=, &throttled_runs, &debounced_runs]() mutable {
+		S([=, &throttled_runs]() mutable {
+			throttled.depend();
+			++throttled_runs;
+		});
+
+		S([=, &debounced_runs]() mutable {
+			debounced.depend();
+			++debounced_runs;
+		});
+	});
+
+	/* throttle lets the first write through right away */
+	input = 1;
+	CHECK(throttled.sample() == 1);
+	CHECK(throttled_runs == 2);
+
+	input = 2;
+	input = 3;
+	now.advance(milliseconds(5));
+	input = 4;
+	CHECK(throttled.sample() == 1);
+	CHECK(debounced.sample() == 0);
+	CHECK(sampled.sample() == 0);
+
+	now.advance(milliseconds(5));
+	timers.poll();
+	CHECK(throttled.sample() == 4);
+	CHECK(throttled_runs == 3);
+	CHECK(sampled.sample() == 4);
+	/* still within 10ms of the last write */
+	CHECK(debounced.sample() == 0);
+
+	now.advance(milliseconds(5));
+	timers.poll();
+	CHECK(debounced.sample() == 4);
+	CHECK(debounced_runs == 2);
+
+	/* nothing pending: the sampler re-arms, the others stay quiet */
+	now.advance(milliseconds(20));
+	timers.poll();
+	CHECK(throttled_runs == 3);
+	CHECK(debounced_runs == 2);
+	CHECK(timers.size() == 1);
+}
+
+TEST(timed_operators_reject_empty_interval) {
+	sig_timers timers;
+	sig<int> input;
+	bool threw = false;
+
+	try {
+		S.debounce(input, std::chrono::milliseconds(0), timers);
+	} catch (const std::invalid_argument &) {
+		threw = true;
+	}
+
+	CHECK(threw);
+}
+
+TEST(effects_run_once_settled) {
+	sig<int> a(1), b, c;
+	int pure_runs = 0;
+	int effect_runs = 0;
+	int settled_runs = 0;
+	vector<int> seen;
+
+	sig_root root([=, &pure_runs, &effect_runs, &seen]() mutable {
+		S([=]() mutable { b = a + 1; });
+		S([=]() mutable { c = b * 2; });
+
+		/* reads a signal from every depth, so it's reached once per tick */
+		S([=, &pure_runs]() mutable {
+			(void) (a + b + c);
+			++pure_runs;
+		});
+
+		S.effect([=, &effect_runs, &seen]() mutable {
+			seen.push_back(a + b + c);
+			++effect_runs;
+		});
+	});
+
+	CHECK(effect_runs == 1);
+	ASSERT(seen.size() == 1);
+	CHECK(seen[0] == 1 + 2 + 4);
+
+	/* the signals live outside the root, so writes to them batch on the thread's clock */
+	subscription settled = S.on_settled([&settled_runs] { ++settled_runs; });
+
+	pure_runs = 0;
+	a = 2;
+	CHECK(pure_runs == 3);
+	CHECK(effect_runs == 2);
+	ASSERT(seen.size() == 2);
+	CHECK(seen[1] == 2 + 3 + 6);
+	CHECK(settled_runs == 1);
+
+	S.freeze([=]() mutable {
+		a = 3;
+	});
+	CHECK(effect_runs == 3);
+	CHECK(settled_runs == 2);
+
+	settled.reset();
+	a = 4;
+	CHECK(effect_runs == 4);
+	CHECK(settled_runs == 2);
+}
+
+TEST(effect_writes_settle_before_next_round) {
+	sig<int> in, out, mirrored;
+	int effect_runs = 0;
+	int settled_runs = 0;
+
+	sig_root root([=, &effect_runs]() mutable {
+		S([=]() mutable { mirrored = out; });
+		S.effect([=, &effect_runs]() mutable {
+			out = in * 10;
+			++effect_runs;
+		});
+	});
+
+	subscription settled = S.on_settled([=, &settled_runs]() mutable {
+		CHECK(mirrored.sample() == in.sample() * 10);
+		++settled_runs;
+	});
+
+	in = 5;
+	CHECK(effect_runs == 2);
+	CHECK(mirrored == 50);
+	CHECK(settled_runs == 1);
+}
+
+TEST(settled_listener_writes_are_applied) {
+	val<int> a, b;
+	int b_seen = 0;
+	int settled_runs = 0;
+
+	sig_root root([=, &b_seen]() mutable {
+		S([=, &b_seen]() mutable { b_seen = b; });
+	});
+
+	/* runs again once its own write has settled, then has nothing left to do */
+	subscription settled = S.on_settled([=, &settled_runs]() mutable {
+		b = a.sample() + 6;
+		++settled_runs;
+	});
+
+	a = 1;
+	CHECK(b.sample() == 7);
+	CHECK(b_seen == 7);
+	CHECK(settled_runs == 2);
+}
+
+TEST(incremental_aggregates) {
+	vector<val<int>> sources;
+	for (int i = 0; i < 100; i++) {
+		sources.emplace_back(i);
+	}
+
+	auto total = S.sum(sources);
+	auto evens = S.count(sources, [](const int &v) { return v % 2 == 0; });
+	auto lowest = S.min(sources);
+	auto highest = S.max(sources);
+	int total_runs = 0;
+	int lowest_runs = 0;
+	int seen_total = 0;
+
+	sig_root root([=, &total_runs, &lowest_runs, &seen_total]() mutable {
+		S([=, &total_runs, &seen_total]() mutable {
+			seen_total = total;
+			++total_runs;
+		});
+		S([=, &lowest_runs]() mutable {
+			(void) lowest.operator const int&();
+			++lowest_runs;
+		});
+	});
+
+	CHECK(total.sample() == 4950);
+	CHECK(evens.sample() == 50);
+	CHECK(lowest.sample() == 0);
+	CHECK(highest.sample() == 99);
+
+	sources[0] = 1000;
+	CHECK(seen_total == 5950);
+	CHECK(evens.sample() == 50);
+	CHECK(lowest.sample() == 1);
+	CHECK(highest.sample() == 1000);
+	CHECK(total_runs == 2);
+	CHECK(lowest_runs == 2);
+
+	/* many sources within one batch propagate once */
+	S.freeze([&sources]() mutable {
+		for (int i = 50; i < 100; i++) {
+			sources[i] = -i;
+		}
+	});
+	CHECK(total_runs == 3);
+	CHECK(lowest.sample() == -99);
+	CHECK(highest.sample() == 1000);
+	CHECK(evens.sample() == 50);
+
+	/* an unchanged result doesn't re-run observers */
+	sources[1] = 2;
+	CHECK(lowest.sample() == -99);
+	CHECK(lowest_runs == 3);
+	CHECK(evens.sample() == 51);
+}
+
+TEST(empty_aggregates) {
+	vector<val<double>> none;
+	auto lowest = S.min(none);
+	auto total = S.sum(none);
+	CHECK(lowest.sample() == 0.0);
+	CHECK(total.sample() == 0.0);
+}
+
+TEST(floating_point_sums_do_not_drift) {
+	vector<val<double>> sources;
+	for (int i = 0; i < 10; i++) {
+		sources.emplace_back(0.1 * i);
+	}
+
+	auto total = S.sum(sources);
+	double start = total.sample();
+
+	/* deltas this far apart cancel out everything smaller */
+	for (int i = 0; i < 100; i++) {
+		sources[i % 10] = 1e20;
+		sources[i % 10] = 0.1 * (i % 10);
+	}
+
+	CHECK(total.sample() == start);
+	CHECK(S.sum(sources).sample() == start);
+	CHECK(std::abs(start - 4.5) < 1e-9);
+}
+
+TEST(sealed_root_propagates_through_fixed_edges) {
+	sig<int> a(1), b(2), sum, doubled;
+	int sum_runs = 0;
+	int doubled_runs = 0;
+
+	sig_root root([=, &sum_runs, &doubled_runs]() mutable {
+		S([=, &sum_runs]() mutable {
+			sum = a + b;
+			++sum_runs;
+		});
+		S([=, &doubled_runs]() mutable {
+			doubled = sum * 2;
+			++doubled_runs;
+		});
+	});
+
+	root.seal();
+	CHECK(a.observer_count() == 1);
+	/* the signals are bound to the thread's clock */
+	std::size_t edges = S.stats().edges;
+
+	/* the edge moves into the sealed graph on first propagation, and stays there */
+	a = 10;
+	CHECK(doubled == 24);
+	CHECK(a.observer_count() == 0);
+	CHECK(S.stats().edges == edges);
+	a = 20;
+	b = 3;
+	CHECK(doubled == 46);
+	CHECK(sum_runs == 4);
+	CHECK(doubled_runs == 4);
+
+	/* unsealed readers of sealed signals are still tracked as usual */
+	int outside_runs = 0;
+	sig_root other([=, &outside_runs]() mutable {
+		S([=, &outside_runs]() mutable {
+			(void) (doubled + 0);
+			++outside_runs;
+		});
+	});
+	a = 21;
+	CHECK(outside_runs == 2);
+	CHECK(doubled == 48);
+}
+
+TEST(sealed_root_can_be_sealed_again) {
+	sig<int> a(1), out;
+	int runs = 0;
+
+	sig_root root([=, &runs]() mutable {
+		S([=, &runs]() mutable {
+			out = a * 2;
+			++runs;
+		});
+	});
+
+	root.seal();
+	a = 2;
+	CHECK(out == 4);
+	CHECK(a.observer_count() == 0);
+
+	/* the edge moved into the first graph goes back to `a` */
+	std::size_t edges = S.stats().edges;
+	root.seal();
+	CHECK(a.observer_count() == 1);
+	CHECK(S.stats().edges == edges);
+	a = 3;
+	CHECK(out == 6);
+	CHECK(runs == 3);
+	a = 4;
+	CHECK(out == 8);
+	CHECK(runs == 4);
+}
+
+TEST(sealed_root_keeps_tracking_unowned_signals) {
+	sig<int, sig_policy<true, false>> hot(1);
+	sig<int> a(1), out;
+	int runs = 0;
+
+	sig_root root([=, &runs]() mutable {
+		S([=, &runs]() mutable {
+			out = a + hot;
+			++runs;
+		});
+	});
+
+	root.seal();
+	a = 2;
+	CHECK(out == 3);
+	hot = 10;
+	CHECK(out == 12);
+	hot = 20;
+	a = 3;
+	CHECK(out == 23);
+	CHECK(runs == 5);
+}
+
+/* only checked in debug builds */
+#ifndef NDEBUG
+TEST(sealed_root_reports_new_reads) {
+	sig<int> flag(0), other(5), out;
+
+	sig_root root([=]() mutable {
+		S([=]() mutable {
+			out = flag ? other + 0 : 0;
+		});
+	});
+
+	root.seal();
+
+	bool thrown = false;
+	try {
+		flag = 1;
+	} catch (const std::logic_error &ex) {
+		CHECK(string(ex.what()) == "sealed computation read a node it didn't depend on when sealed");
+		thrown = true;
+	}
+	CHECK(thrown);
+}
+#endif
+
+TEST(sealed_root_rejects_new_computations) {
+	sig<int> flag(0);
+	vector<string> errors;
+
+	sig_root root([=]() mutable {
+		S([=]() mutable {
+			if (flag) S([] {});
+		});
+	});
+	root.on_error([&errors](std::exception_ptr ep) {
+		try {
+			std::rethrow_exception(ep);
+		} catch (const std::logic_error &ex) {
+			errors.push_back(ex.what());
+		}
+	});
+
+	root.seal();
+	flag = 1;
+
+	ASSERT(errors.size() == 1);
+	CHECK(errors[0] == "computations can't be created within a sealed root");
+}
+
+#ifdef LIBSIG_EVENTFD
+#include <poll.h>
+
+TEST(event_bridge_batches_posted_writes) {
+	sig_bridge bridge;
+	/* posted writes share a freeze, so the last one has to win */
+	sig<int, sig_policy<true, true, false>> total;
+	int runs = 0;
+	int seen = 0;
+
+	sig_root root([=, &runs, &seen]() mutable {
+		S([=, &runs, &seen]() mutable {
+			seen = total;
+			++runs;
+		});
+	});
+
+	struct pollfd pfd = {bridge.fd(), POLLIN, 0};
+	CHECK(::poll(&pfd, 1, 0) == 0);
+
+	thread poster([&bridge, total]() mutable {
+		for (int i = 1; i <= 1000; i++) {
+			bridge.post(total, i);
+		}
+	});
+
+	int drains = 0;
+	while (seen != 1000) {
+		ASSERT(::poll(&pfd, 1, 5000) == 1);
+		bridge.drain();
+		++drains;
+	}
+	poster.join();
+
+	/* one propagation per drain, however many writes it applied */
+	CHECK(runs == drains + 1);
+	CHECK(::poll(&pfd, 1, 0) == 0);
+	CHECK(bridge.drain() == 0);
+}
+
+TEST(event_bridge_drops_a_batch_that_throws) {
+	sig_bridge bridge;
+	sig<int> a, b;
+
+	bridge.post(a, 1);
+	bridge.post([] { throw std::runtime_error("bad post"); });
+	bridge.post(b, 1);
+
+	bool thrown = false;
+	try {
+		bridge.drain();
+	} catch (const std::runtime_error &) {
+		thrown = true;
+	}
+
+	CHECK(thrown);
+	CHECK(a == 1);
+	CHECK(b == 0);
+
+	/* later posts still wake the loop, and nothing from the failed batch runs again */
+	int runs = 0;
+	bridge.post([&runs] { ++runs; });
+	struct pollfd pfd = {bridge.fd(), POLLIN, 0};
+	CHECK(::poll(&pfd, 1, 0) == 1);
+	CHECK(bridge.drain() == 1);
+	CHECK(runs == 1);
+}
+
+TEST(event_bridge_drains_timers) {
+	using std::chrono::milliseconds;
+
+	manual_time now;
+	sig_timers timers(now);
+	sig_bridge bridge(timers);
+	val<int> input(0);
+	auto debounced = S.debounce(input, milliseconds(10), timers);
+
+	CHECK(bridge.timeout() == -1);
+
+	bridge.post(input, 5);
+	CHECK(bridge.drain() == 1);
+	CHECK(input == 5);
+	CHECK(bridge.timeout() == 10);
+
+	now.advance(milliseconds(4) + std::chrono::microseconds(500));
+	CHECK(bridge.timeout() == 6);
+
+	now.advance(milliseconds(6));
+	CHECK(bridge.timeout() == 0);
+	CHECK(bridge.drain() == 1);
+	CHECK(debounced.sample() == 5);
+}
+#endif
+
+TEST(memoized_results_are_reused) {
+	sig<int> zoom(1), scale(10);
+	int runs = 0;
+
+	auto tiles = S.memoize([=, &runs]() mutable {
+		++runs;
+		return zoom * scale;
+	}, 2);
+
+	int seen = 0;
+	sig_root root([=, &seen]() mutable {
+		S([=, &seen]() mutable { seen = tiles; });
+	});
+
+	CHECK(seen == 10);
+	CHECK(runs == 1);
+
+	zoom = 2;
+	CHECK(seen == 20);
+	CHECK(runs == 2);
+
+	/* flipping back hits the cache, and stays subscribed */
+	zoom = 1;
+	CHECK(seen == 10);
+	CHECK(runs == 2);
+	CHECK(tiles.hits() == 1);
+
+	zoom = 2;
+	CHECK(seen == 20);
+	CHECK(runs == 2);
+	CHECK(tiles.hits() == 2);
+
+	/* a third key evicts the least recently used one (zoom == 1) */
+	zoom = 3;
+	CHECK(seen == 30);
+	CHECK(runs == 3);
+	CHECK(tiles.cached() == 2);
+	zoom = 1;
+	CHECK(runs == 4);
+	CHECK(tiles.misses() == 4);
+
+	/* any recorded input counts */
+	scale = 100;
+	CHECK(seen == 100);
+	CHECK(runs == 5);
+}
+
+TEST(memoized_runs_reading_other_nodes_are_not_cached) {
+	sig<int> a(1);
+	auto doubled = S.derive(expr(a) * 2);
+	int runs = 0;
+
+	auto m = S.memoize([=, &runs]() mutable {
+		++runs;
+		return doubled + 1;
+	});
+
+	CHECK(m.sample() == 3);
+	a = 2;
+	a = 1;
+	CHECK(m.sample() == 3);
+	CHECK(runs == 3);
+	CHECK(m.cached() == 0);
+}
+
+TEST(memoized_runs_with_untracked_reads_are_not_cached) {
+	sig<int> a(1), b(1);
+	sig<int, sig_policy<false>> untracked(5);
+	int runs = 0;
+
+	auto sampled = S.memoize([=, &runs]() mutable {
+		++runs;
+		return a + b.sample();
+	});
+	auto mixed = S.memoize([=]() mutable {
+		return a + untracked;
+	});
+
+	CHECK(sampled.sample() == 2);
+	CHECK(mixed.sample() == 6);
+
+	b = 10;
+	untracked = 20;
+	a = 2;
+	a = 1;
+
+	CHECK(sampled.sample() == 11);
+	CHECK(mixed.sample() == 21);
+	CHECK(runs == 3);
+	CHECK(sampled.cached() == 0);
+	CHECK(mixed.cached() == 0);
+}
+
+TEST(memoized_run_that_throws_stops_recording) {
+	sig<int> a(1);
+
+	auto m = S.memoize([=]() mutable {
+		if (a == 2) throw std::runtime_error("bad input");
+		return a * 10;
+	});
+
+	bool threw = false;
+	try {
+		a = 2;
+	} catch (const std::runtime_error &) {
+		threw = true;
+	}
+
+	CHECK(threw);
+	CHECK(libsig::detail::system.recording == nullptr);
+
+	a = 3;
+	CHECK(m.sample() == 30);
+}
+
+TEST(errors_are_isolated_to_failing_nodes) {
+	sig<int> x(1);
+	int before_runs = 0;
+	int after_runs = 0;
+	int after_seen = 0;
+	vector<string> errors;
+
+	sig_root root([=, &before_runs, &after_runs, &after_seen]() mutable {
+		S([=, &before_runs]() mutable {
+			int v = x;
+			++before_runs;
+			if (v == 2) throw std::runtime_error("bad input");
+		});
+		S([=, &after_runs, &after_seen]() mutable {
+			after_seen = x;
+			++after_runs;
+		});
+	});
+
+	root.on_error([&errors](std::exception_ptr ep) {
+		try {
+			std::rethrow_exception(ep);
+		} catch (const std::exception &ex) {
+			errors.push_back(ex.what());
+		}
+	});
+
+	/* the rest of the tick still runs */
+	x = 2;
+	ASSERT(errors.size() == 1);
+	CHECK(errors[0] == "bad input");
+	CHECK(after_seen == 2);
+	CHECK(root.stats().errors == 1);
+
+	/* the failing computation stays live and recovers */
+	x = 3;
+	CHECK(before_runs == 3);
+	CHECK(after_seen == 3);
+	CHECK(errors.size() == 1);
+}
+
+TEST(computation_error_boundary) {
+	sig<int> x(1);
+	int own_errors = 0;
+	int root_errors = 0;
+	shared_ptr<computation> failing;
+
+	sig_root root([=, &own_errors, &failing]() mutable {
+		failing = make_shared<computation>(S([=]() mutable {
+			if (x == 2) throw std::runtime_error("bad input");
+		}, [&own_errors](std::exception_ptr) { ++own_errors; }));
+	});
+	root.on_error([&root_errors](std::exception_ptr) { ++root_errors; });
+
+	CHECK(!failing->failed());
+	x = 2;
+	CHECK(own_errors == 1);
+	CHECK(root_errors == 0);
+	CHECK(failing->failed());
+
+	x = 3;
+	CHECK(!failing->failed());
+}
+
+TEST(failed_runs_are_handled_alike_by_both_boundaries) {
+	for (bool own : {true, false}) {
+		sig<int> x(1), partial;
+		int seen = 0;
+		int errors = 0;
+		shared_ptr<computation> failing;
+		sig_error_boundary count = [&errors](std::exception_ptr) { ++errors; };
+
+		sig_root root([=, &seen, &failing]() mutable {
+			failing = make_shared<computation>(S([=]() mutable {
+				partial = x * 10;
+				if (x == 2) throw std::runtime_error("bad input");
+			}, own ? count : nullptr));
+			S([=, &seen]() mutable { seen = partial; });
+		});
+		if (!own) root.on_error(count);
+
+		/* what was written before throwing is still applied */
+		x = 2;
+		CHECK(errors == 1);
+		CHECK(failing->failed());
+		CHECK(seen == 20);
+		CHECK(root.stats().errors == 1);
+
+		x = 3;
+		CHECK(!failing->failed());
+		CHECK(seen == 30);
+	}
+}
+
+TEST(unhandled_errors_propagate_after_the_batch) {
+	sig<int> x(1);
+	int seen = 0;
+
+	sig_root root([=, &seen]() mutable {
+		S([=]() mutable {
+			if (x == 2) throw std::runtime_error("bad input");
+		});
+		S([=, &seen]() mutable { seen = x; });
+		S([=]() mutable {
+			if (x == 2) throw std::logic_error("also bad");
+		});
+	});
+
+	bool thrown = false;
+	try {
+		x = 2;
+	} catch (const std::runtime_error &) {
+		thrown = true;
+	}
+
+	/* the rest of the batch ran first; only the first error propagates */
+	CHECK(thrown);
+	CHECK(seen == 2);
+	CHECK(root.stats().errors == 2);
+
+	x = 3;
+	CHECK(seen == 3);
+
+	/* batches started by a freeze rethrow as it ends */
+	thrown = false;
+	try {
+		S.freeze([=]() mutable { x = 2; });
+	} catch (const std::runtime_error &) {
+		thrown = true;
+	}
+
+	CHECK(thrown);
+	CHECK(seen == 2);
+}
+
+TEST(root_error_boundary_covers_building) {
+	sig<int> x(1);
+	int seen = 0;
+	int errors = 0;
+
+	sig_root root([=, &seen]() mutable {
+		S.build([=, &seen]() mutable {
+			S([=]() mutable {
+				if (x == 1) throw std::runtime_error("bad input");
+			});
+			S([=, &seen]() mutable { seen = x; });
+		});
+	}, [&errors](std::exception_ptr) { ++errors; });
+
+	CHECK(errors == 1);
+	CHECK(seen == 1);
+	CHECK(root.stats().errors == 1);
+
+	x = 2;
+	CHECK(seen == 2);
+	CHECK(errors == 1);
+}